@@ -22,9 +22,18 @@
 
 #include "adc.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 #include <stdlib.h>
 #include "config.h"
+#include "capture.h"
+#include "stats.h"
+#include "onewire.h"
+#include "display.h"
 
 /**
  * \defgroup adc A/D reading
@@ -33,51 +42,1076 @@
  */
 
 /**
- * \brief Returns the A/D converter conversion result.
+ * ADC channel for every scheduler slot.
+ */
+#if ADC_SLOTS == 3
+static const uint8_t AdcChannel[ ADC_SLOTS ] PROGMEM = { GEAR_PIN, NEUTRAL_PIN, LIGHT_PIN };
+#else
+static const uint8_t AdcChannel[ ADC_SLOTS ] PROGMEM = { GEAR_PIN, LIGHT_PIN };
+#endif
+
+/**
+ * Last samples of every channel.
+ */
+static volatile uint8_t AdcRing[ ADC_SLOTS ][ ADC_RING_SIZE ];
+
+/**
+ * Index of the latest sample in \ref AdcRing.
+ */
+static volatile uint8_t AdcHead[ ADC_SLOTS ];
+
+/**
+ * Slot being converted.
+ */
+static uint8_t AdcSlot;
+
+/**
+ * Set if the current conversion is the first one after channel change.
+ */
+static uint8_t AdcDiscard;
+
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+/**
+ * Set by ADC interrupt when conversion started by AdcSleepConvert() is done.
+ */
+static volatile uint8_t AdcConverted;
+#endif
+
+/**
+ * \name Gear sensor oversampling
+ * @{
+ */
+static uint16_t AdcSum; ///< Sum of gear sensor conversions
+static uint8_t AdcCount; ///< Number of summed conversions
+static volatile uint16_t GearSample; ///< The latest decimated gear sample
+///@}
+
+#if MAX_GEAR_NUMBER >= GEAR_SPLIT-1
+#error "Gear numbers do not fit in 4-bit gear table codes"
+#endif
+
+/**
+ * Gear decoding table, built by BuildGearTable() from \ref CONFIGURATION.GearLevel.
+ */
+typedef struct
+{
+	/**
+	 * Gear code for every 8 most significant bits of gear sensor reading,
+	 * even entries in low nibble, odd in high nibble. Codes are gear numbers
+	 * with \ref GEAR_SPLIT flag or \ref GEAR_TABLE_UNKNOWN.
+	 */
+	uint8_t Code[128];
+	/// Upper boundary of every gear, readings above the boundary of the last gear are unknown
+	uint16_t Boundary[ MAX_GEAR_NUMBER ];
+	/// Number of gears in \a Boundary
+	uint8_t Count;
+} GEARTABLE;
+
+/**
+ * The table in use and the one rebuilt by BuildGearTable(). Interrupt
+ * never sees partially built table, only the pointer is swapped.
+ */
+static GEARTABLE GearTables[2];
+
+/**
+ * Table used by GearDecode(), changed only by BuildGearTable().
+ */
+static const GEARTABLE* volatile pGearTable = GearTables;
+
+/**
+ * Gear code after filtering, see \ref GEAR_FILTER.
+ */
+static volatile uint8_t FilteredGear = GEAR_UNKNOWN;
+
+/**
+ * \name Shift tracking state
+ * @{
+ */
+/// Gear position stable, \ref ShiftGear is valid
+#define SHIFT_STABLE 0
+/// Sensor in unknown band, shift in progress
+#define SHIFT_MOVING 1
+
+/// Current state of shift tracking
+static uint8_t ShiftState;
+/// The last stable gear or \ref GEAR_UNKNOWN
+static uint8_t ShiftGear = GEAR_UNKNOWN;
+/// Direction of drift of stable readings from \ref ShiftGear level, +1 up, -1 down, 0 none
+static int8_t ShiftDrift;
+/// Number of consecutive stable readings with \ref ShiftDrift, up to \ref SHIFT_CONFIRM_N
+static uint8_t ShiftDriftCount;
+/// Confirmed direction of the shift in progress, 0 if not known
+static int8_t ShiftNext;
+/// Number of consecutive samples in unknown band, up to \ref SHIFT_CONFIRM_N
+static uint8_t ShiftUnknown;
+/// Number of samples since the shift started
+static uint16_t ShiftTimer;
+/// \ref g_Ticks when the shift started, for StatsShift()
+static uint16_t ShiftStart;
+/// Gear expected at the end of the shift or \ref GEAR_UNKNOWN
+static volatile uint8_t ShiftPredicted = GEAR_UNKNOWN;
+///@}
+
+#ifdef GEAR_ADAPTIVE_RATE
+/**
+ * \name Adaptive sampling rate state
+ * @{
+ */
+/// Pause after scheduler cycle in display frames
+static volatile uint8_t AdcPause = GEAR_RATE_PAUSE( GEAR_RATE_MAX_HZ );
+/// Display frames until sampling is resumed, \b 0 if sampling runs
+static volatile uint8_t AdcWait;
+/// Number of quiet gear samples
+static uint8_t GearQuiet;
+///@}
+#endif
+
+#ifdef GEAR_CALIBRATION
+/**
+ * \name Gear calibration state
+ * Samples are summed by ADC interrupt in blocks of \ref CALIB_SAMPLES,
+ * the block is handed over to CalibrateGears().
+ * @{
+ */
+/// Gear of the block being summed
+static uint8_t CalibGear;
+/// Number of samples in the block being summed
+static uint8_t CalibCount;
+/// Sum of samples
+static uint16_t CalibSum;
+/// Sum of absolute differences between consecutive samples
+static uint16_t CalibDev;
+/// Previous sample
+static uint16_t CalibPrev;
+/// Set when the complete block is ready for CalibrateGears()
+static volatile uint8_t CalibReady;
+/// Gear of the complete block
+static uint8_t CalibBlockGear;
+/// Sum of samples of the complete block
+static uint16_t CalibBlockSum;
+/// Sum of deviations of the complete block
+static uint16_t CalibBlockDev;
+///@}
+#endif
+
+/**
+ * \brief Selects input for the next conversion.
+ * \param slot Scheduler slot.
+ */
+static inline void AdcSelect( uint8_t slot )
+{
+	ADMUX = pgm_read_byte( AdcChannel + slot ) | _BV( REFS0 ); //10bit + AVCC
+#if ADC_ACQUISITION == ADC_ACQUISITION_FREE
+	AdcDiscard = 1; //the first reading after changing ADC channel may be corrupted
+#endif
+}
+
+/**
+ * \brief Starts background ADC sampling.
+ *
+ * Channels from \ref AdcChannel are converted one after another by ADC
+ * interrupt. Prescaler is 64 (125kHz ADC clock at 8MHz, within 50-200kHz
+ * range for full 10-bit resolution), one conversion takes 104us. The first
+ * conversion after channel change is discarded.
+ *
+ * Gear sensor is converted \ref GEAR_OVERSAMPLE times in a row, sum is
+ * decimated to \ref GEAR_BITS result. Noise of the sensor line works as dither.
+ * Other channels are converted once and stored as 8-bit values.
+ *
+ * \par Throughput per channel
+ * | Oversampling | Slots | Gear sample   | Neutral, light | Cycle  |
+ * |--------------|-------|---------------|----------------|--------|
+ * | none, 10-bit | 3     | 1603Hz 10-bit | 1603Hz 8-bit   | 624us  |
+ * | 4x, 11-bit   | 3     | 1068Hz 11-bit | 1068Hz 8-bit   | 936us  |
+ * | 16x, 12-bit  | 3     | 458Hz 12-bit  | 458Hz 8-bit    | 2184us |
+ * | none, 10-bit | 2     | 2404Hz 10-bit | 2404Hz 8-bit   | 416us  |
+ * | 4x, 11-bit   | 2     | 1374Hz 11-bit | 1374Hz 8-bit   | 728us  |
+ * | 16x, 12-bit  | 2     | 506Hz 12-bit  | 506Hz 8-bit    | 1976us |
+ *
+ * Neutral indicator has its slot only if it is not read by pin change
+ * interrupt, see \ref NEUTRAL_PIN_CHANGE.
+ *
+ * ADC interrupt is called every 104us (ca 60 cycles), independently of
+ * oversampling.
+ *
+ * With \ref ADC_ACQUISITION_SLEEP conversions are not started here, display
+ * interrupt starts one conversion before every row, see AdcSleepConvert().
+ *
+ * With \ref ADC_ACQUISITION_TRIGGER conversions are started by hardware on
+ * timer0 compare match A. The first timer0 period of every row is dark, display
+ * interrupt clears OCF0A flag at its beginning and the rising flag triggers
+ * conversion at \ref ADC_TRIGGER_OCR, sample and hold follows 2 ADC clocks
+ * later, still before the row is lit. The flag is left set for the rest of the
+ * row, no other trigger occurs. One conversion per row (3425Hz) takes no CPU
+ * time except ADC interrupt. Row has at most 8 lit steps instead of 9, the full
+ * brightness is ca 11% lower.
+ * Channel is changed long before the next trigger, no conversion is discarded.
+ *
+ * | Oversampling | Slots | Gear sample   | Neutral, light | Cycle  |
+ * |--------------|-------|---------------|----------------|--------|
+ * | none, 10-bit | 3     | 1141Hz 10-bit | 1141Hz 8-bit   | 876us  |
+ * | none, 10-bit | 2     | 1712Hz 10-bit | 1712Hz 8-bit   | 584us  |
+ *
+ * \sa AdcLatest() AdcAverage() ADC_SAMPLE_US
+ */
+void InitADC()
+{
+	AdcSlot = 0;
+	AdcSelect( AdcSlot );
+
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+	ADCSRA = _BV( ADEN ) | _BV( ADIE ) | _BV(ADPS1) | _BV(ADPS2);
+#elif ADC_ACQUISITION == ADC_ACQUISITION_TRIGGER
+	OCR0A = ADC_TRIGGER_OCR;
+	TIFR0 = _BV( OCF0A ); //the display interrupt arms the trigger
+	ADCSRB = _BV( ADTS1 ) | _BV( ADTS0 ); //timer0 compare match A
+	ADCSRA = _BV( ADEN ) | _BV( ADIE ) | _BV( ADATE ) | _BV(ADPS1) | _BV(ADPS2);
+#else
+	ADCSRA = _BV( ADEN ) | _BV( ADIE ) | _BV( ADSC ) | _BV(ADPS1) | _BV(ADPS2);
+#endif
+}
+
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+/**
+ * \brief Converts the next scheduled channel in ADC Noise Reduction sleep mode.
+ *
+ * Called from display interrupt before a row is lit, all LEDs are off.
+ * Entering the sleep mode starts conversion, CPU and I/O clocks are stopped
+ * until ADC interrupt wakes the CPU up. Neither LED switching nor CPU activity
+ * disturbs the measurement.
+ *
+ * Timer0 is stopped too, so the display interrupt is not nested and the row
+ * is not shortened or stretched: every row and the copy step is preceded by
+ * 104us dark gap, which lowers brightness of the whole display by ca 30%.
+ * The gap delays \ref g_Ticks, see \ref TICKS_PER_SECOND. Timer1 is stopped as well.
+ *
+ * Other enabled interrupts may be served during the conversion.
+ *
+ * 1-Wire transfer needs timer2 running: while it is in progress the conversion
+ * is started in Idle mode with display interrupt masked instead, see OwStatus().
+ *
+ * \par Throughput per channel
+ * | Oversampling | Slots | Gear sample   | Neutral, light | Cycle  |
+ * |--------------|-------|---------------|----------------|--------|
+ * | none, 10-bit | 3     | 917Hz 10-bit  | 917Hz 8-bit    | 1090us |
+ * | none, 10-bit | 2     | 1375Hz 10-bit | 1375Hz 8-bit   | 727us  |
+ */
+void AdcSleepConvert()
+{
+	uint8_t smcr = SMCR; //sleep mode of the interrupted code
+
+	uint8_t timsk = TIMSK0;
+
+	AdcConverted = 0;
+
+	if( OW_BUSY == OwStatus() )
+	{
+		//timers run, display interrupt must not nest
+		TIMSK0 = 0;
+		set_sleep_mode( SLEEP_MODE_IDLE );
+		ADCSRA |= _BV( ADSC );
+	}
+	else
+	{
+		set_sleep_mode( SLEEP_MODE_ADC );
+	}
+
+	sleep_enable();
+	sei(); //ADC interrupt must wake up the CPU
+
+	do
+	{
+		sleep_cpu(); //starts conversion if ADC is idle
+	} while( !AdcConverted );
+
+	cli();
+	SMCR = smcr;
+	TIMSK0 = timsk;
+}
+#endif
+
+/**
+ * \brief Decodes gear sensor sample.
+ *
+ * \ref GEARTABLE.Code is indexed by 8 most significant bits of the sample. Entries
+ * with \ref GEAR_SPLIT flag contain boundary of gear, the sample is compared
+ * with \ref GEARTABLE.Boundary. Takes constant time.
+ *
+ * \param value Sample in \ref GEAR_BITS precision.
+ * \return Gear code.
+ */
+static inline uint8_t GearDecode( uint16_t value )
+{
+	const GEARTABLE* pTable = pGearTable;
+	uint8_t i = value >> (GEAR_BITS-8);
+	uint8_t g = pTable->Code[ i >> 1 ];
+
+	if( i & 1 )
+		g >>= 4;
+	g &= 0x0F;
+
+	if( GEAR_TABLE_UNKNOWN == g )
+		return GEAR_UNKNOWN;
+
+	if( g & GEAR_SPLIT )
+	{
+		g &= ~GEAR_SPLIT;
+
+		if( value > pTable->Boundary[ g-1 ] )
+			g = g < pTable->Count ? g+1 : GEAR_UNKNOWN;
+	}
+
+	return g;
+}
+
+/**
+ * \brief Passes gear sensor sample through selected filter.
+ *
+ * Called from ADC interrupt for every gear sample. Result is stored in
+ * \ref FilteredGear.
+ *
+ * \param value Gear sensor sample, \ref GEAR_BITS precision.
+ * \sa GEAR_FILTER
+ */
+static inline void GearFilter( uint16_t value )
+{
+#if GEAR_FILTER == GEAR_FILTER_MEDIAN
+	static uint16_t window[ GEAR_MEDIAN_N ];
+	static uint8_t index;
+	uint16_t sorted[ GEAR_MEDIAN_N ];
+
+	window[ index ] = value;
+	if( ++index >= GEAR_MEDIAN_N )
+		index = 0;
+
+	//insertion sort, N is small
+	for( uint8_t i = 0; i < GEAR_MEDIAN_N; i++ )
+	{
+		uint16_t v = window[ i ];
+		uint8_t j = i;
+
+		for( ; j > 0 && sorted[ j-1 ] > v; j-- )
+			sorted[ j ] = sorted[ j-1 ];
+
+		sorted[ j ] = v;
+	}
+
+	FilteredGear = GearDecode( sorted[ GEAR_MEDIAN_N/2 ] );
+
+#elif GEAR_FILTER == GEAR_FILTER_IIR
+	//fixed point with fraction bits that keep difference in int16_t
+	static uint16_t acc;
+	const uint8_t frac = 15 - GEAR_BITS;
+
+	acc += (int16_t)( (value << frac) - acc ) >> GEAR_IIR_SHIFT;
+
+	FilteredGear = GearDecode( acc >> frac );
+
+#elif GEAR_FILTER == GEAR_FILTER_CONSECUTIVE
+	static uint8_t candidate;
+	static uint8_t count;
+	uint8_t g = GearDecode( value );
+
+	if( g != candidate )
+	{
+		candidate = g;
+		count = 0;
+	}
+
+	if( count < GEAR_CONSECUTIVE_N )
+		count++;
+
+	if( count >= GEAR_CONSECUTIVE_N )
+		FilteredGear = candidate;
+
+#else
+	FilteredGear = GearDecode( value );
+#endif
+}
+
+#ifdef GEAR_CALIBRATION
+/**
+ * \brief Sums stable gear sample for calibration.
+ *
+ * Called from ADC interrupt only for samples of confirmed stable gear.
+ * Costs a few additions per sample, all computations are done by CalibrateGears().
+ *
+ * \param g Gear.
+ * \param value Gear sensor sample, \ref GEAR_BITS precision.
+ */
+static inline void CalibSample( uint8_t g, uint16_t value )
+{
+	if( g != CalibGear )
+	{
+		CalibGear = g;
+		CalibCount = 0;
+		CalibSum = 0;
+		CalibDev = 0;
+		CalibPrev = value;
+	}
+
+	CalibSum += value;
+	CalibDev += value > CalibPrev ? value - CalibPrev : CalibPrev - value;
+	CalibPrev = value;
+
+	if( ++CalibCount >= CALIB_SAMPLES )
+	{
+		//the previous block not taken yet, drop this one
+		if( !CalibReady )
+		{
+			CalibBlockGear = g;
+			CalibBlockSum = CalibSum;
+			CalibBlockDev = CalibDev;
+			CalibReady = 1;
+		}
+
+		CalibCount = 0;
+		CalibSum = 0;
+		CalibDev = 0;
+	}
+}
+#endif
+
+#ifdef GEAR_ADAPTIVE_RATE
+/**
+ * \brief Switches sampling to the high rate.
+ *
+ * Pause in progress ends with the next display frame.
+ */
+static inline void GearActive()
+{
+	GearQuiet = 0;
+	AdcPause = GEAR_RATE_PAUSE( GEAR_RATE_MAX_HZ );
+
+	if( AdcWait > 1 )
+		AdcWait = 1;
+}
+
+/**
+ * \brief Selects sampling rate from gear signal activity.
+ *
+ * Called from ADC interrupt for every gear sample, after ShiftTrack().
+ * Signal moves if two consecutive samples differ more than \ref GEAR_ACTIVE_DELTA,
+ * it is in unknown band or shift is in progress. The rate drops to
+ * \ref GEAR_RATE_MIN_HZ after \ref GEAR_QUIET_SAMPLES quiet samples.
+ *
+ * \param value Gear sensor sample, \ref GEAR_BITS precision.
+ * \sa AdcFrame()
+ */
+static inline void GearActivity( uint16_t value )
+{
+	static uint16_t prev;
+	uint16_t delta = value > prev ? value - prev : prev - value;
+
+	prev = value;
+
+	if( delta > GEAR_LEVEL(GEAR_ACTIVE_DELTA) || SHIFT_MOVING == ShiftState || GEAR_UNKNOWN == FilteredGear )
+		GearActive();
+	else if( GearQuiet < GEAR_QUIET_SAMPLES && ++GearQuiet == GEAR_QUIET_SAMPLES )
+		AdcPause = GEAR_RATE_PAUSE( GEAR_RATE_MIN_HZ );
+}
+#endif
+
+/**
+ * \brief Tracks gear shift.
+ *
+ * Called from ADC interrupt for every gear sample, after GearFilter().
+ *
+ * The first sample in the unknown band (\ref CONFIGURATION.UnknownLevel)
+ * after a stable gear starts a shift. The next gear is predicted only if the
+ * direction is confirmed: the last gear can go only down, for other gears
+ * \ref SHIFT_CONFIRM_N consecutive stable readings must drift more than
+ * \ref SHIFT_DRIFT from the gear level towards the neighbour. The first
+ * position is never predicted, it can go to the first gear, neutral or the
+ * second gear. With \ref NEUTRAL_INDICATOR neutral lies between the first and
+ * the second gear, so the second gear going down is not predicted either.
+ * The prediction is published after \ref SHIFT_CONFIRM_N
+ * consecutive samples in unknown band, single glitches are ignored.
+ *
+ * The shift ends when the raw sample and the filtered gear agree on the same gear,
+ * or it is cancelled after \ref SHIFT_TIMEOUT samples. Duration of shifts
+ * to another gear and cancelled shifts are counted by StatsShift().
+ *
+ * \param value Gear sensor sample, \ref GEAR_BITS precision.
+ * \sa PredictGear()
+ */
+static inline void ShiftTrack( uint16_t value )
+{
+	uint8_t g = GearDecode( value );
+
+	if( SHIFT_STABLE == ShiftState )
+	{
+		if( GEAR_UNKNOWN != g )
+		{
+			if( g == FilteredGear )
+			{
+				int16_t drift = (int16_t)value - g_Config.GearLevel[ g-1 ];
+				int8_t dir = drift > (int16_t)GEAR_LEVEL(SHIFT_DRIFT) ? +1 :
+					(drift < -(int16_t)GEAR_LEVEL(SHIFT_DRIFT) ? -1 : 0);
+
+				if( g != ShiftGear || dir != ShiftDrift )
+				{
+					ShiftDrift = dir;
+					ShiftDriftCount = 0;
+				}
+
+				if( ShiftDriftCount < SHIFT_CONFIRM_N )
+					ShiftDriftCount++;
+
+				ShiftGear = g;
+
+#ifdef GEAR_CALIBRATION
+				CalibSample( g, value );
+#endif
+			}
+			return;
+		}
+
+		if( GEAR_UNKNOWN == ShiftGear )
+			return; //no stable gear yet
+
+		//entering unknown band
+		uint8_t count = g_Config.MaxGearNumber;
+		if( count > MAX_GEAR_NUMBER )
+			count = MAX_GEAR_NUMBER;
+
+		if( ShiftGear <= 1 || count <= 1 )
+			ShiftNext = 0;
+#ifdef NEUTRAL_INDICATOR
+		else if( 2 == ShiftGear && ShiftDrift < 0 )
+			ShiftNext = 0; //can be the first gear or neutral
+#endif
+		else if( ShiftGear >= count )
+			ShiftNext = -1;
+		else
+			ShiftNext = ShiftDriftCount >= SHIFT_CONFIRM_N ? ShiftDrift : 0;
+
+		ShiftState = SHIFT_MOVING;
+		ShiftUnknown = 1;
+		ShiftTimer = 0;
+		ShiftStart = GetTicks();
+	}
+	else if( GEAR_UNKNOWN != g && g == FilteredGear )
+	{
+		//confirmed or cancelled, filtered gear is valid again
+		if( g != ShiftGear )
+			StatsShift( GetTicks() - ShiftStart );
+
+		ShiftGear = g;
+		ShiftDrift = 0;
+		ShiftDriftCount = 0;
+		ShiftState = SHIFT_STABLE;
+		ShiftPredicted = GEAR_UNKNOWN;
+	}
+	else if( ++ShiftTimer >= SHIFT_TIMEOUT )
+	{
+		//stuck between gears, wait for stable gear
+		StatsShift( STATS_SHIFT_CANCELLED );
+		ShiftGear = GEAR_UNKNOWN;
+		ShiftState = SHIFT_STABLE;
+		ShiftPredicted = GEAR_UNKNOWN;
+	}
+	else if( GEAR_UNKNOWN != g )
+	{
+		ShiftUnknown = 0; //glitch or the new level before the filter passes it
+	}
+	else if( ShiftUnknown < SHIFT_CONFIRM_N && ++ShiftUnknown == SHIFT_CONFIRM_N && ShiftNext )
+	{
+		ShiftPredicted = ShiftGear + ShiftNext;
+	}
+}
+
+/**
+ * \brief ADC conversion complete interrupt.
+ *
+ * Sums gear sensor conversions, stores result in the ring buffer of the
+ * current channel, switches to the next channel and starts the next conversion.
+ */
+ISR(ADC_vect)
+{
+	uint16_t value = ADC; //10 bit
+	uint8_t done = 1;
+
+	if( AdcDiscard )
+	{
+		AdcDiscard = 0;
+		done = 0;
+	}
+	else if( ADC_GEAR == AdcSlot )
+	{
+		//oversampling, the channel stays selected
+		AdcSum += value;
+
+		if( ++AdcCount < GEAR_OVERSAMPLE )
+		{
+			done = 0;
+		}
+		else
+		{
+			value = AdcSum >> GEAR_OVERSAMPLE_BITS;
+			GearSample = value;
+			AdcSum = 0;
+			AdcCount = 0;
+
+#if GEAR_DECODER != GEAR_DECODER_RATIO
+			GearFilter( value );
+			ShiftTrack( value );
+#ifdef GEAR_ADAPTIVE_RATE
+			GearActivity( value );
+#endif
+#ifdef GEAR_CAPTURE
+			if( CaptureSample( value, bit_is_set( PINC, NEUTRAL_PIN ), GEAR_UNKNOWN == GearDecode( value ) ) )
+			{
+#ifdef GEAR_ADAPTIVE_RATE
+				GearActive(); //capture needs fixed rate
+#endif
+			}
+#endif
+#endif
+			value >>= GEAR_OVERSAMPLE_BITS; //10 bit for ring buffer
+		}
+	}
+
+	if( done )
+	{
+		uint8_t head = (AdcHead[ AdcSlot ] + 1) & (ADC_RING_SIZE-1);
+
+		AdcRing[ AdcSlot ][ head ] = value >> 2; //8 bit
+		AdcHead[ AdcSlot ] = head;
+
+		if( ++AdcSlot >= ADC_SLOTS )
+		{
+			AdcSlot = 0;
+
+#ifdef GEAR_ADAPTIVE_RATE
+			//end of scheduler cycle, AdcFrame() resumes sampling
+			if( AdcPause )
+			{
+				AdcWait = AdcPause;
+#if ADC_ACQUISITION == ADC_ACQUISITION_TRIGGER
+				ADCSRA &= ~_BV(ADATE);
+#endif
+			}
+#endif
+		}
+
+		AdcSelect( AdcSlot );
+	}
+
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+	AdcConverted = 1; //the next conversion is started by AdcSleepConvert()
+#elif ADC_ACQUISITION == ADC_ACQUISITION_FREE
+#ifdef GEAR_ADAPTIVE_RATE
+	if( !AdcWait )
+#endif
+		ADCSRA |= _BV(ADSC);
+#endif
+}
+
+#ifdef GEAR_ADAPTIVE_RATE
+/**
+ * \brief Resumes paused sampling.
+ *
+ * Called from display interrupt once per frame (\ref DISPLAY_FRAME_US).
+ * After every scheduler cycle ADC interrupt pauses sampling for
+ * \ref AdcPause frames, the pause is set by GearActivity().
+ *
+ * | Signal | Gear sample rate                      | ADC interrupts          |
+ * |--------|---------------------------------------|-------------------------|
+ * | moving | \ref GEAR_RATE_MAX_HZ, full by default | every conversion        |
+ * | stable | ca \ref GEAR_RATE_MIN_HZ               | one cycle, then pause   |
+ *
+ * Costs ca 10 cycles per frame.
+ */
+void AdcFrame()
+{
+	if( AdcWait && !--AdcWait )
+	{
+#if ADC_ACQUISITION == ADC_ACQUISITION_TRIGGER
+		ADCSRA |= _BV(ADATE); //the next dark row step triggers conversion
+#else
+		ADCSRA |= _BV(ADSC);
+#endif
+	}
+}
+#endif
+
+/**
+ * \brief Returns the latest conversion result.
+ *
+ * Function does not wait for ADC. It can be called from interrupt.
+ *
+ * \param slot Scheduler slot, e.g. \ref ADC_GEAR.
+ *
+ * \return 8 bit ADC conversion result.
+ */
+uint8_t AdcLatest( uint8_t slot )
+{
+	return AdcRing[ slot ][ AdcHead[ slot ] ];
+}
+
+/**
+ * \brief Returns average of the last \ref ADC_RING_SIZE conversion results.
+ *
+ * Function does not wait for ADC. It can be called from interrupt.
+ *
+ * \param slot Scheduler slot, e.g. \ref ADC_GEAR.
+ *
+ * \return 8 bit average.
+ */
+uint8_t AdcAverage( uint8_t slot )
+{
+	uint16_t sum = 0;
+
+	for( uint8_t i = 0; i < ADC_RING_SIZE; i++ )
+		sum += AdcRing[ slot ][ i ];
+
+	return sum / ADC_RING_SIZE;
+}
+
+/**
+ * \brief Returns amount of light in phototransistor.
+ *
+ * \return 8 bit ADC result.
+*/
+uint8_t GetLight()
+{
+	return AdcLatest( ADC_LIGHT );
+}
+
+/**
+ * \brief Returns filtered gear code.
+ *
+ * Function does not wait for ADC. It can be called from interrupt.
+ *
+ * \return Gear number from \b 1 or \ref GEAR_UNKNOWN.
+ * \sa GEAR_FILTER
+ */
+uint8_t GearFiltered()
+{
+	return FilteredGear;
+}
+
+/**
+ * \brief Builds gear decoding table from configuration.
+ *
+ * Every reading is assigned to the nearest level from \ref CONFIGURATION.GearLevel,
+ * the boundary between two gears is in the middle of their levels.
+ * Readings equal or above \ref CONFIGURATION.UnknownLevel are \ref GEAR_UNKNOWN.
+ *
+ * Table entry covers 2^(\ref GEAR_BITS-8) readings. If a boundary falls inside
+ * the entry, the entry gets \ref GEAR_SPLIT flag and the reading is compared with
+ * \ref GEARTABLE.Boundary. Levels closer than two entries can not be told apart.
+ *
+ * The table not used by ADC interrupt is built and swapped with the used one
+ * atomically, so interrupt never decodes with boundaries and codes that
+ * do not match. There is no room for two tables of whole bytes, codes are
+ * stored in nibbles.
+ *
+ * Levels must be sorted, \a GearLevel[0] is the first gear.
+ * Only \ref CONFIGURATION.MaxGearNumber levels are used.
+ *
+ * Must be called every time \ref g_Config is changed.
+ *
+ * \sa GetGear()
+ */
+void BuildGearTable()
+{
+	//only this function changes the pointer, interrupt uses the other table
+	GEARTABLE* pTable = pGearTable == GearTables ? GearTables+1 : GearTables;
+	uint8_t count = g_Config.MaxGearNumber;
+	uint8_t g = 0;
+	uint16_t i;
+
+	if( count > MAX_GEAR_NUMBER )
+		count = MAX_GEAR_NUMBER;
+
+	for( i = 0; i < count; i++ )
+	{
+		//the middle between levels, the last gear ends below unknown band
+		if( i+1 < count )
+			pTable->Boundary[i] = ((uint32_t)g_Config.GearLevel[i] + g_Config.GearLevel[i+1]) / 2;
+		else
+			pTable->Boundary[i] = g_Config.UnknownLevel ? g_Config.UnknownLevel-1 : 0;
+	}
+
+	pTable->Count = count;
+
+	for( i = 0; i < 256; i++ )
+	{
+		uint16_t low = i << (GEAR_BITS-8);
+		uint16_t high = low + GEAR_LEVEL(1) - 1;
+		uint8_t code;
+
+		//the first gear that ends above the lowest reading of the entry
+		while( g < count && low > pTable->Boundary[g] )
+			g++;
+
+		if( g >= count || 0 == g_Config.UnknownLevel )
+			code = GEAR_TABLE_UNKNOWN;
+		else if( high > pTable->Boundary[g] )
+			code = (g+1) | GEAR_SPLIT;
+		else
+			code = g+1;
+
+		if( i & 1 )
+			pTable->Code[ i >> 1 ] |= code << 4;
+		else
+			pTable->Code[ i >> 1 ] = code;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pGearTable = pTable;
+	}
+}
+
+/**
+ * \brief Adjusts gear levels to the sensor readings.
+ *
+ * Must be called periodically from the main loop. For every block of stable
+ * readings from the ADC interrupt the centroid and the spread (mean absolute
+ * difference of consecutive readings, it does not depend on level offset)
+ * of the gear readings are updated with \ref CALIB_SHIFT filter.
+ *
+ * If the centroid differs from \ref CONFIGURATION.GearLevel the level is
+ * moved by one step towards it and gear table is rebuilt. Levels are not
+ * moved when the readings are noisy (spread over \ref CALIB_MAX_SPREAD) or
+ * when they would get closer than \ref CALIB_MIN_GAP to the adjacent level or
+ * the unknown band.
+ *
+ * Every \ref CALIB_SAVE_BLOCKS blocks levels are stored in EEPROM, only if
+ * any of them differs at least \ref CALIB_SAVE_DELTA from the stored one.
  *
- * \param channel ADC channel, from \b 0 to \b 7.
+ * \note If \ref GEAR_CALIBRATION is not defined function does nothing.
  *
- * \return 8 bit ADC conversion result.
+ * \sa BuildGearTable()
+ */
+void CalibrateGears()
+{
+#ifdef GEAR_CALIBRATION
+	//fixed point, the sum of the block has 16-GEAR_BITS fraction bits
+	const uint8_t frac = 16 - GEAR_BITS;
+	static uint16_t centroid[ MAX_GEAR_NUMBER ];
+	static uint16_t spread[ MAX_GEAR_NUMBER ];
+	static uint16_t blocks;
+
+	if( !CalibReady )
+		return;
+
+	//interrupt does not touch the block until CalibReady is cleared
+	uint8_t g = CalibBlockGear-1;
+	uint16_t sum = CalibBlockSum;
+	uint16_t dev = CalibBlockDev;
+	CalibReady = 0;
+
+	uint8_t count = g_Config.MaxGearNumber;
+	if( count > MAX_GEAR_NUMBER )
+		count = MAX_GEAR_NUMBER;
+
+	if( g >= count )
+		return;
+
+	if( 0 == centroid[g] )
+	{
+		centroid[g] = sum;
+		spread[g] = dev;
+	}
+	else
+	{
+		centroid[g] += ((int32_t)sum - centroid[g]) >> CALIB_SHIFT;
+		spread[g] += ((int32_t)dev - spread[g]) >> CALIB_SHIFT;
+	}
+
+	uint16_t level = g_Config.GearLevel[g];
+	uint16_t target = (centroid[g] + (1 << (frac-1))) >> frac;
+
+	if( (spread[g] >> frac) <= GEAR_LEVEL(CALIB_MAX_SPREAD) )
+	{
+		if( target > level &&
+			level + GEAR_LEVEL(CALIB_MIN_GAP) < g_Config.UnknownLevel &&
+			(g+1 >= count || level + GEAR_LEVEL(CALIB_MIN_GAP) < g_Config.GearLevel[g+1]) )
+		{
+			level++;
+		}
+		else if( target < level &&
+			level > GEAR_LEVEL(CALIB_MIN_GAP) &&
+			(0 == g || level > g_Config.GearLevel[g-1] + GEAR_LEVEL(CALIB_MIN_GAP)) )
+		{
+			level--;
+		}
+
+		if( level != g_Config.GearLevel[g] )
+		{
+			//ShiftTrack() reads the level in ADC interrupt
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				g_Config.GearLevel[g] = level;
+			}
+
+			//builds the table not used by interrupt, too long to block interrupts
+			BuildGearTable();
+		}
+	}
+
+	//store in EEPROM rarely
+	if( ++blocks >= CALIB_SAVE_BLOCKS )
+	{
+		blocks = 0;
+
+		for( uint8_t i = 0; i < count; i++ )
+		{
+			if( abs( (int16_t)g_Config.GearLevel[i] - eeprom_read_word( &ee_Config.GearLevel[i] ) ) >= GEAR_LEVEL(CALIB_SAVE_DELTA) )
+			{
+				WriteConfig();
+				break;
+			}
+		}
+	}
+#endif
+}
+
+/**
+ * \brief Returns number of the highest gear.
  *
- * \note ADC unit should be enabled and configured properly.
+ * \ref GEAR_DECODER_LADDER stores neutral in the first level, so its top gear is
+ * one less than \ref CONFIGURATION.MaxGearNumber, for other decoders it is equal.
+ *
+ * \return The highest gear number returned by GetGear().
+ * \sa MAX_GEAR_NUMBER
  */
+uint8_t TopGear()
+{
+	uint8_t count = g_Config.MaxGearNumber;
+
+	if( count > MAX_GEAR_NUMBER )
+		count = MAX_GEAR_NUMBER;
+
+#if GEAR_DECODER == GEAR_DECODER_LADDER
+	return count ? count-1 : 0;
+#else
+	return count;
+#endif
+}
 
-uint8_t GetADC( uint8_t channel )
+#if GEAR_DECODER != GEAR_DECODER_RATIO
+/**
+ * \brief Returns gear sensor reading used for gear levels.
+ *
+ * \return The latest oversampled gear sensor sample, \ref GEAR_BITS precision.
+ * \sa CONFIGURATION.GearLevel
+ */
+uint16_t GearSensor()
 {
-	ADMUX = channel | _BV( REFS0 ) | _BV(ADLAR); //8bit + AVCC
+	uint16_t value;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		value = GearSample;
+	}
+
+	return value;
+}
+#endif
+
+/*.*****************************************************************************
+ * GEAR DECODERS, SELECTED BY GEAR_DECODER
+ *.*****************************************************************************/
 
-	//start conversion.
-	ADCSRA |= _BV(ADSC);
+#ifdef NEUTRAL_INDICATOR
+#ifdef NEUTRAL_PIN_CHANGE
+/**
+ * State of neutral indicator, updated by pin change interrupt.
+ */
+static volatile uint8_t NeutralOn;
 
-	 //wait for the 1st result
-	loop_until_bit_is_clear( ADCSRA, ADSC );
+/**
+ * \brief Stores state of neutral indicator.
+ *
+ * Called from pin change interrupt on every edge of \ref NEUTRAL_PIN, neutral
+ * entry and exit is known within microseconds.
+ *
+ * \param pins State of port C.
+ */
+static inline void NeutralChange( uint8_t pins )
+{
+	NeutralOn = pins & _BV(NEUTRAL_PIN);
 
-	return ADCH; //left adjusted = 8 bit
+#if defined(GEAR_ADAPTIVE_RATE) && GEAR_DECODER != GEAR_DECODER_RATIO
+	GearActive(); //rider is shifting
+#endif
 }
 
 /**
- * \brief Returns amount of light in phototransistor.
+ * \brief Checks neutral indicator line.
+ * \return Non zero if gearbox is in neutral position.
+ */
+static inline uint8_t IsNeutral()
+{
+	return NeutralOn;
+}
+#else
+/**
+ * ADC reading of neutral indicator above which gearbox is in neutral position.
+ */
+#define NEUTRAL_LEVEL 50
+
+/**
+ * \brief Checks neutral indicator line.
  *
- * \return 8 bit ADC result.
-*/
-uint8_t GetLight()
+ * Reading analog allows more fine tune of the threshold than digital input.
+ *
+ * \return Non zero if gearbox is in neutral position.
+ */
+static inline uint8_t IsNeutral()
+{
+	return AdcLatest(ADC_NEUTRAL) >= NEUTRAL_LEVEL;
+}
+#endif
+#endif
+
+/**
+ * \brief Initializes hardware used by the gear decoder.
+ *
+ * Analog inputs are sampled by ADC started with InitADC(), neutral indicator
+ * by pin change interrupt if \ref NEUTRAL_PIN_CHANGE is defined.
+ */
+void InitGearDecoder()
 {
-	return GetADC( LIGHT_PIN );
+#if GEAR_DECODER == GEAR_DECODER_DIGITAL
+	GEAR_DIGITAL_PULLUP |= GEAR_DIGITAL_N | GEAR_DIGITAL_1 | GEAR_DIGITAL_2 | GEAR_DIGITAL_3 |
+		GEAR_DIGITAL_4 | GEAR_DIGITAL_5 | GEAR_DIGITAL_6;
+#elif GEAR_DECODER == GEAR_DECODER_RATIO
+	TCCR1A = 0; //normal mode
+	TCCR1B = _BV(ICNC1) | _BV(ICES1) | _BV(CS11) | _BV(CS10); //noise canceler, rising edge, 8MHz/64
+	TIMSK1 = _BV(ICIE1) | _BV(TOIE1);
+
+	PCMSK1 |= _BV(RATIO_WHEEL_PIN);
+	PCICR |= _BV(PCIE1);
+#endif
+
+#if defined(NEUTRAL_INDICATOR) && defined(NEUTRAL_PIN_CHANGE)
+	NeutralChange( PINC );
+	PCMSK1 |= _BV(NEUTRAL_PIN); //PCINT11
+	PCICR |= _BV(PCIE1);
+#endif
 }
 
+#if GEAR_DECODER == GEAR_DECODER_DEMO
+
 /**
  * \brief Demo gear box procedure.
  *
  * This is example gear box routine. It does not read real gear box
- * but continuously changes gear every 1s.
- * You must write your own procedure that reads appropriate data
- * from your gear box interface. Typically it reads ADC converter pins.
+ * but changes gear after every 200 calls, about every 4s when called by
+ * the main loop every 20ms.
+ * Select decoder for your gear box interface with \ref GEAR_DECODER.
  *
  * \warning
  * This is an example procedure. It does not return real gear number.
  *
  * \return Gear number. \b 0 for neutral, 1 to 5 for gears.
- * \sa CONFIGURATION GetADC() GetLight()
+ * \sa CONFIGURATION AdcLatest() GetLight()
  */
 uint8_t GetGear()
 {
@@ -97,6 +1131,22 @@ uint8_t GetGear()
 	return gear;
 }
 
+/**
+ * \brief Demo gear prediction.
+ *
+ * Demo gear box does not change gears through unknown band,
+ * so nothing is predicted.
+ *
+ * \return Always \ref GEAR_UNKNOWN.
+ * \sa GetGear()
+ */
+uint8_t PredictGear()
+{
+	return GEAR_UNKNOWN;
+}
+
+#elif GEAR_DECODER == GEAR_DECODER_DL650
+
 /*
  * \page gps Gearbox Position Sensor Suzuki DL650
  *
@@ -121,40 +1171,20 @@ uint8_t GetGear()
  * - \b black/white - ground
  */
 
-
-/*.*****************************************************************************
- * EXAMPLE PROCEDURE FOR SUZUKI DL650 AND 2 ADC LINES.
- *.*****************************************************************************/
-
-/*
- * \brief Return current gear number.
- *
- * Reads ADC and then convert voltage to gear number based on data stored
- * in configuration CONFIGURATION.GearLevel and CONFIGURATION.GearNumber
- *
- * Gear sensor voltage is sampled 10 times every 2ms and then average value
- * is used.
- *
- * It takes ca 20ms to obtain gear number.
+/**
+ * \brief Return current gear number, Suzuki DL650 sensor.
  *
- * Voltage levels in g_Config.GearLevel must be sorted, lowest level for neutral
- * highest for 6th.
+ * Reads gear code decoded by the table from BuildGearTable() from filtered gear sensor samples
+ * (\ref GEAR_PIN). Neutral is read from separate indicator line (\ref NEUTRAL_PIN).
+ * Worst case latency is \ref GEAR_FILTER_LATENCY_US.
  *
  * \return Gear number from 0 to 6. \b 0 indicates neutral position, the first gear is 1, 6 sixth.
  *
- *
- *
- * \sa CONFIGURATION GetADC() GetLight()
- * \sa \ref gps IsNeutral()
- *
+ * \sa CONFIGURATION AdcLatest() GetLight()
+ * \sa \ref gps
  */
-#if 0
 uint8_t GetGear()
 {
-	const uint8_t NEUTRAL = 50;
-	const uint8_t UNKNOWN = 254; //=4.9V
-	const uint8_t TOLERANCE = 10;
-
 	static uint8_t gear; //stores gear number when position is unknown (pos between gears)
 
 	/** \par Voltage divider
@@ -165,32 +1195,332 @@ uint8_t GetGear()
 	 * 2V = 100
 	 */
 
-	//Port can be used in digital input mode, but reading analog allows more fine tune.
-	if( GetADC(NEUTRAL_PIN) >= NEUTRAL )
+	if( IsNeutral() )
 	{
-		gear=0;
+		gear=GEAR_NEUTRAL;
 		return gear; //neutral position
 	}
 
-	GetADC( GEAR_PIN ); //(the first reading after changing ADC channel may be corrupted
-	int adc = GetADC( GEAR_PIN ); //works better (more stable)
+	uint8_t g = GearFiltered();
 
 	//Gearbox gives 5V if it's in unknown position (when changing gears)
-	if( adc >= g_Config.UnknownLevel )
-		return gear;
+	if( g != GEAR_UNKNOWN )
+		gear = g;
+
+	return gear;
+}
+
+/**
+ * \brief Returns gear expected at the end of the shift in progress.
+ *
+ * Prediction is available \ref SHIFT_CONFIRM_N gear samples after the sensor enters
+ * unknown band if the shift direction is confirmed, before the new level settles
+ * and passes the filter. Caller can start
+ * gear animation early. When shift ends GetGear() returns the real gear,
+ * which confirms the prediction or cancels it.
+ *
+ * \return Predicted gear number or \ref GEAR_UNKNOWN if no shift is in progress
+ * or direction is not known.
+ * \sa GetGear() ShiftTrack()
+ */
+uint8_t PredictGear()
+{
+	if( IsNeutral() )
+		return GEAR_UNKNOWN; //neutral position
+
+	return ShiftPredicted;
+}
+
+#ifdef NEUTRAL_PIN_CHANGE
+/**
+ * \brief Neutral indicator, pin change on \ref NEUTRAL_PIN.
+ */
+ISR(PCINT1_vect)
+{
+	NeutralChange( PINC );
+}
+#endif
+
+#elif GEAR_DECODER == GEAR_DECODER_LADDER
+
+/**
+ * \brief Return current gear number, resistor ladder sensor.
+ *
+ * Every position of the gearbox switches different resistor, one analog line
+ * (\ref GEAR_PIN) gives all positions. \a GearLevel[0] is the neutral level,
+ * \a GearLevel[1] the first gear and so on, \ref CONFIGURATION.MaxGearNumber
+ * includes neutral. Worst case latency is \ref GEAR_FILTER_LATENCY_US.
+ *
+ * \return Gear number, \b 0 for neutral.
+ * \sa CONFIGURATION BuildGearTable()
+ */
+uint8_t GetGear()
+{
+	static uint8_t gear; //stores gear number when position is unknown
+
+	uint8_t g = GearFiltered();
+
+	if( g != GEAR_UNKNOWN )
+		gear = g-1; //the first level is neutral
+
+	return gear;
+}
+
+/**
+ * \brief Returns gear expected at the end of the shift in progress.
+ *
+ * \return Predicted gear number or \ref GEAR_UNKNOWN.
+ * \sa GetGear() ShiftTrack()
+ */
+uint8_t PredictGear()
+{
+	uint8_t g = ShiftPredicted;
+
+	return g == GEAR_UNKNOWN ? g : g-1;
+}
+
+#elif GEAR_DECODER == GEAR_DECODER_DIGITAL
+
+/**
+ * Input mask for neutral and every gear, read from \ref GEAR_DIGITAL_PORT.
+ * \b 0 means gear is not connected.
+ */
+static const uint8_t GearInput[ MAX_GEAR_NUMBER+1 ] PROGMEM =
+{
+	GEAR_DIGITAL_N, GEAR_DIGITAL_1, GEAR_DIGITAL_2, GEAR_DIGITAL_3,
+	GEAR_DIGITAL_4, GEAR_DIGITAL_5, GEAR_DIGITAL_6
+};
+
+/**
+ * \brief Return current gear number, one input per gear.
+ *
+ * Every gear closes its own switch to ground. Inputs are active low,
+ * internal pull-ups must be enabled. Every call checks all inputs, so
+ * time does not depend on gear. If no input or more than one input is active
+ * (between gears) the previous gear is returned.
+ *
+ * \return Gear number, \b 0 for neutral.
+ * \sa GEAR_DIGITAL_PORT
+ */
+uint8_t GetGear()
+{
+	static uint8_t gear; //stores gear number when position is unknown
 
-	static uint8_t g;
+	uint8_t pins = ~GEAR_DIGITAL_PORT;
+	uint8_t found = GEAR_UNKNOWN;
+	uint8_t count = 0;
 
-	for(g=0; g<g_Config.MaxGearNumber-1;g++)
+	for( uint8_t g = 0; g < MAX_GEAR_NUMBER+1; g++ )
 	{
-		if( adc-TOLERANCE >= g_Config.GearLevel[5-g] )
+		if( pins & pgm_read_byte( GearInput + g ) )
 		{
-			gear = 5-g+1;
-			return gear;
+			found = g;
+			count++;
 		}
 	}
 
-	return 1;
+	if( 1 == count )
+		gear = found;
+
+	return gear;
+}
+
+/**
+ * \brief Switches give no information before the new gear is engaged.
+ *
+ * \return Always \ref GEAR_UNKNOWN.
+ * \sa GetGear()
+ */
+uint8_t PredictGear()
+{
+	return GEAR_UNKNOWN;
+}
+
+#elif GEAR_DECODER == GEAR_DECODER_RATIO
+
+/**
+ * Upper 16 bits of Timer1 time, counted by overflow interrupt.
+ */
+static volatile uint16_t Timer1High;
+
+/**
+ * \name Pulse periods in Timer1 ticks
+ * @{
+ */
+static volatile uint32_t RpmLast; ///< Time of the last engine pulse
+static volatile uint32_t RpmPeriod; ///< Engine pulse period
+static volatile uint32_t WheelLast; ///< Time of the last wheel pulse
+static volatile uint32_t WheelPeriod; ///< Wheel pulse period
+static volatile uint8_t WheelNew; ///< Set by every wheel pulse
+///@}
+
+/**
+ * \brief Extends 16-bit Timer1 value to 32 bits.
+ *
+ * Must be called with interrupts disabled.
+ *
+ * \param t Timer1 value, TCNT1 or ICR1.
+ * \return Time in Timer1 ticks.
+ */
+static inline uint32_t Timer1Time( uint16_t t )
+{
+	uint16_t high = Timer1High;
+
+	//overflow not served yet, t was taken after it
+	if( bit_is_set( TIFR1, TOV1 ) && t < 0x8000 )
+		high++;
+
+	return ((uint32_t)high << 16) | t;
+}
+
+/**
+ * \brief Timer1 overflow, extends timer to 32 bits.
+ */
+ISR(TIMER1_OVF_vect)
+{
+	Timer1High++;
+}
+
+/**
+ * \brief Engine pulse captured on ICP1.
+ *
+ * Only stores the period, it takes a few dozens cycles and does not delay
+ * the display interrupt. At 15000rpm and one pulse per revolution it is
+ * called 250 times per second.
+ */
+ISR(TIMER1_CAPT_vect)
+{
+	uint32_t t = Timer1Time( ICR1 );
+
+	RpmPeriod = t - RpmLast;
+	RpmLast = t;
+}
+
+/**
+ * \brief Wheel pulse, pin change on \ref RATIO_WHEEL_PIN.
+ *
+ * Both edges trigger the interrupt, only rising edge is used.
+ * The interrupt is shared with neutral indicator, see \ref NEUTRAL_PIN_CHANGE.
+ */
+ISR(PCINT1_vect)
+{
+	static uint8_t last; //previous state of port C
+	uint8_t pins = PINC;
+	uint8_t rising = pins & ~last;
+
+	last = pins;
+
+#ifdef NEUTRAL_PIN_CHANGE
+	NeutralChange( pins );
+#endif
+
+	if( !(rising & _BV(RATIO_WHEEL_PIN)) )
+		return;
+
+	uint32_t t = Timer1Time( TCNT1 );
+
+	WheelPeriod = t - WheelLast;
+	WheelLast = t;
+	WheelNew = 1;
+}
+
+/**
+ * \brief Computes ratio of engine and wheel pulse periods.
+ *
+ * \return Period ratio in \ref RATIO_SCALE fixed point, \ref GEAR_BITS precision.
+ * Maximum value when engine or wheel is stopped.
+ */
+static uint16_t Ratio()
+{
+	uint32_t rpm, wheel, rpmAge, wheelAge;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uint32_t now = Timer1Time( TCNT1 );
+
+		rpm = RpmPeriod;
+		wheel = WheelPeriod;
+		rpmAge = now - RpmLast;
+		wheelAge = now - WheelLast;
+	}
+
+	const uint16_t max = (1 << GEAR_BITS) - 1;
+
+	if( !rpm || !wheel || rpmAge > RATIO_TIMEOUT || wheelAge > RATIO_TIMEOUT )
+		return max;
+
+	uint32_t r = rpm * GEAR_LEVEL(RATIO_SCALE) / wheel;
+
+	return r > max ? max : r;
+}
+
+/**
+ * \brief Return current gear number, engine and wheel speed ratio.
+ *
+ * Gear is not read from sensor but estimated from ratio of engine and wheel
+ * pulse periods. For every wheel pulse the ratio is computed and passed
+ * through the same filter, gear table and calibration as ADC samples
+ * in analog decoders, so \ref CONFIGURATION.GearLevel are learned per gear ratios.
+ * Ratio over \ref CONFIGURATION.UnknownLevel (clutch pulled, wheel or engine
+ * stopped) keeps the previous gear. Neutral is read from indicator line
+ * (\ref NEUTRAL_PIN).
+ *
+ * The only division is done here, once per wheel pulse, not in interrupt.
+ *
+ * \return Gear number, \b 0 for neutral.
+ * \sa GEAR_DECODER_RATIO RATIO_SCALE
+ */
+uint8_t GetGear()
+{
+	static uint8_t gear; //stores gear number when ratio is unknown
+
+	if( IsNeutral() )
+	{
+		gear = GEAR_NEUTRAL;
+		return gear;
+	}
+
+	if( WheelNew )
+	{
+		uint16_t r = Ratio();
+
+		WheelNew = 0;
+
+		GearFilter( r );
+		ShiftTrack( r );
+	}
+
+	uint8_t g = GearFiltered();
+
+	if( g != GEAR_UNKNOWN )
+		gear = g;
+
+	return gear;
+}
+
+/**
+ * \brief Ratio gives no information before the new gear is engaged.
+ *
+ * \return Always \ref GEAR_UNKNOWN.
+ * \sa GetGear()
+ */
+uint8_t PredictGear()
+{
+	return GEAR_UNKNOWN;
 }
+
+/**
+ * \brief Returns the last engine and wheel speed ratio.
+ *
+ * \return Period ratio in \ref RATIO_SCALE fixed point, \ref GEAR_BITS precision.
+ */
+uint16_t GearSensor()
+{
+	return Ratio();
+}
+
+#else
+#error Unknown GEAR_DECODER
 #endif
+
 /** @} */
@@ -34,8 +34,365 @@
 #define NEUTRAL_PIN 3
 ///@}
 
-uint8_t GetADC( uint8_t channel );
+/**
+ * Number of samples stored for every channel. Must be power of 2.
+ */
+#define ADC_RING_SIZE 4
+
+/**
+ * \name ADC acquisition modes
+ * How conversions are started, selected by \ref ADC_ACQUISITION.
+ * @{
+ */
+/// Free running, every conversion is started by ADC interrupt, see InitADC()
+#define ADC_ACQUISITION_FREE 0
+/// ADC Noise Reduction sleep before every display row, see AdcSleepConvert()
+#define ADC_ACQUISITION_SLEEP 1
+/// Auto trigger by timer0 compare in dark step of every display row, see InitADC()
+#define ADC_ACQUISITION_TRIGGER 2
+///@}
+
+#ifndef ADC_ACQUISITION
+/**
+ * Selected acquisition mode.
+ */
+#define ADC_ACQUISITION ADC_ACQUISITION_FREE
+#endif
+
+/**
+ * Gear sensor oversampling, 4^bits conversions are summed and decimated
+ * to 10+bits result. From 0 to 2.
+ * Conversions with dark display are clean enough without oversampling.
+ */
+#if ADC_ACQUISITION == ADC_ACQUISITION_FREE
+#define GEAR_OVERSAMPLE_BITS 2
+#else
+#define GEAR_OVERSAMPLE_BITS 0
+#endif
+
+/// Number of conversions for one gear sample
+#define GEAR_OVERSAMPLE ( 1 << (2*GEAR_OVERSAMPLE_BITS) )
+
+/// Precision of gear samples and \ref CONFIGURATION.GearLevel in bits
+#define GEAR_BITS ( 10 + GEAR_OVERSAMPLE_BITS )
+
+/// Converts 8-bit reading to \ref GEAR_BITS precision
+#define GEAR_LEVEL(x) ( (uint16_t)(x) << (GEAR_BITS-8) )
+
+/// One conversion time in microseconds, 13 cycles of 125kHz ADC clock
+#define ADC_CONVERSION_US 104
+
+/// Display interrupts per frame, 8 rows of 9 interrupts and the copy step
+#define ADC_FRAME_TICKS 73
+
+/// Display frame time in microseconds when timer0 runs all the time
+#define DISPLAY_FRAME_US ( ADC_FRAME_TICKS*256UL*1000000UL/F_CPU )
+
+#if ADC_ACQUISITION == ADC_ACQUISITION_FREE
+/**
+ * Gear sensor sampling period in microseconds, see InitADC().
+ * One discarded and \ref GEAR_OVERSAMPLE conversions of gear sensor,
+ * one discarded and one conversion for other channels.
+ */
+#define ADC_SAMPLE_US ( (GEAR_OVERSAMPLE + 1 + 2*(ADC_SLOTS-1)) * ADC_CONVERSION_US )
+#else
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+/// Conversions per display frame, one before every row and one in the copy step
+#define ADC_FRAME_CONVERSIONS 9
+/// Display frame time in microseconds, timer0 stops during conversions
+#define ADC_FRAME_US ( DISPLAY_FRAME_US + ADC_FRAME_CONVERSIONS*ADC_CONVERSION_US )
+#else
+/// Conversions per display frame, one in the first step of every row
+#define ADC_FRAME_CONVERSIONS 8
+/// Display frame time in microseconds
+#define ADC_FRAME_US DISPLAY_FRAME_US
+#endif
+
+/**
+ * Gear sensor sampling period in microseconds.
+ * \ref GEAR_OVERSAMPLE conversions of gear sensor and one conversion for
+ * other channels, at the display row rate.
+ */
+#define ADC_SAMPLE_US ( (GEAR_OVERSAMPLE + ADC_SLOTS-1) * ADC_FRAME_US / ADC_FRAME_CONVERSIONS )
+#endif
+
+/**
+ * Value of OCR0A for \ref ADC_ACQUISITION_TRIGGER.
+ * Display interrupt must clear OCF0A before compare match, otherwise the
+ * trigger of the row is lost. Interrupt response and vector jump take 7 cycles,
+ * the prologue ca 35 cycles (the interrupt calls functions, r0, r1, SREG and 12
+ * call-clobbered registers are saved) and the dark step test ca 8 cycles,
+ * ca 50 cycles until OCF0A is cleared, more if another interrupt delays it.
+ * Sample and hold takes place 131 cycles after compare match and must fall
+ * before the end of the dark timer0 period, OCR0A must be at most 124.
+ */
+#define ADC_TRIGGER_OCR 96
+
+/**
+ * \name Gear codes
+ * Values from \b 1 to \ref MAX_GEAR_NUMBER are gear numbers.
+ * Gear table stores 4-bit codes.
+ * @{
+ */
+#define GEAR_NEUTRAL 0
+/// Position between gears
+#define GEAR_UNKNOWN 0xFF
+/// Position between gears in gear table
+#define GEAR_TABLE_UNKNOWN 0x0F
+/// Flag of table entry with boundary between gear and the next one
+#define GEAR_SPLIT 0x08
+///@}
+
+/**
+ * \name Gear decoders
+ * Implementation of GetGear() and PredictGear(), selected by \ref GEAR_DECODER.
+ * \ref GEAR_DECODER_CYCLES is the approximate cost of one GetGear() call in CPU cycles,
+ * analog decoders add \ref GEAR_FILTER cost to every ADC gear sample.
+ * @{
+ */
+/// Demo, changes gear after 200 calls (ca 4s). ~20 cycles.
+#define GEAR_DECODER_DEMO 0
+/// Suzuki DL650, gear levels on \ref GEAR_PIN, neutral line on \ref NEUTRAL_PIN. ~40 cycles.
+#define GEAR_DECODER_DL650 1
+/// Resistor ladder, neutral and all gears on \ref GEAR_PIN, up to neutral and 5 gears. ~30 cycles.
+#define GEAR_DECODER_LADDER 2
+/// One digital input per gear on \ref GEAR_DIGITAL_PORT. ~80 cycles.
+#define GEAR_DECODER_DIGITAL 3
+/// Ratio of engine and wheel speed, Timer1 input capture. ~650 cycles with new wheel pulse, ~60 without.
+#define GEAR_DECODER_RATIO 4
+///@}
+
+#ifndef GEAR_DECODER
+/**
+ * Selected gear decoder.
+ */
+#define GEAR_DECODER GEAR_DECODER_DEMO
+#endif
+
+#if GEAR_DECODER == GEAR_DECODER_DL650
+#define GEAR_DECODER_CYCLES 40
+#elif GEAR_DECODER == GEAR_DECODER_LADDER
+#define GEAR_DECODER_CYCLES 30
+#elif GEAR_DECODER == GEAR_DECODER_DIGITAL
+#define GEAR_DECODER_CYCLES 80
+#elif GEAR_DECODER == GEAR_DECODER_RATIO
+#define GEAR_DECODER_CYCLES 650
+#else
+#define GEAR_DECODER_CYCLES 20
+#endif
+
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP && GEAR_DECODER == GEAR_DECODER_RATIO
+#error "Timer1 is stopped in ADC Noise Reduction mode, ratio decoder needs free running ADC"
+#endif
+
+#if GEAR_DECODER == GEAR_DECODER_DL650 || GEAR_DECODER == GEAR_DECODER_RATIO
+/**
+ * Decoder reads neutral indicator line on \ref NEUTRAL_PIN, see IsNeutral().
+ */
+#define NEUTRAL_INDICATOR
+#endif
+
+/**
+ * Read neutral indicator as digital input with pin change interrupt (PCINT11)
+ * instead of ADC. Indicator gives 3.6V at 10V, over 3V input high threshold
+ * down to 8.4V, Schmitt trigger hysteresis rejects noise.
+ */
+#define NEUTRAL_PIN_CHANGE
+
+/**
+ * \name ADC scheduler slots
+ * Channels sampled in background by ADC interrupt, see AdcLatest().
+ * Neutral indicator is sampled only if it is not read by pin change interrupt.
+ * @{
+ */
+#define ADC_GEAR 0
+#if defined(NEUTRAL_INDICATOR) && !defined(NEUTRAL_PIN_CHANGE)
+#define ADC_NEUTRAL 1
+#define ADC_LIGHT 2
+/// Number of sampled channels
+#define ADC_SLOTS 3
+#else
+#define ADC_LIGHT 1
+/// Number of sampled channels
+#define ADC_SLOTS 2
+#endif
+///@}
+
+/**
+ * \name Inputs of \ref GEAR_DECODER_DIGITAL
+ * Port and pin masks of neutral and gear switches, \b 0 if not connected.
+ * The board has only 12V input (PC3) and auxiliary pin #1 (PC0) free,
+ * other gears need different MCU package or board.
+ * @{
+ */
+#define GEAR_DIGITAL_PORT PINC
+#define GEAR_DIGITAL_PULLUP PORTC
+#define GEAR_DIGITAL_N _BV(3)
+#define GEAR_DIGITAL_1 _BV(0)
+#define GEAR_DIGITAL_2 0
+#define GEAR_DIGITAL_3 0
+#define GEAR_DIGITAL_4 0
+#define GEAR_DIGITAL_5 0
+#define GEAR_DIGITAL_6 0
+///@}
+
+/**
+ * \name Inputs of \ref GEAR_DECODER_RATIO
+ * Engine pulses are captured on ICP1 (PB0), wheel pulses by pin change
+ * interrupt, both timed by Timer1 running at 125kHz (8us).
+ * On this board PB0 drives the LED matrix, the decoder needs board with ICP1
+ * routed to engine pulse input.
+ *
+ * \ref CONFIGURATION.GearLevel stores engine pulse period * \ref RATIO_SCALE /
+ * wheel pulse period for every gear, it grows with gear number.
+ * Default levels (see ReadConfig()) are for one engine pulse per crankshaft and
+ * one wheel pulse per wheel revolution, online calibration adjusts them to the bike.
+ * @{
+ */
+/// Wheel pulse input on port C (PC0, auxiliary pin #1, PCINT8)
+#define RATIO_WHEEL_PIN 0
+/// Fixed point scale of the period ratio, choose it to get gear levels from ca 50 to 250 (in 8-bit units)
+#define RATIO_SCALE 1024
+/// Time without pulse after which engine or wheel is stopped, Timer1 ticks (0.5s)
+#define RATIO_TIMEOUT 62500UL
+///@}
+
+/**
+ * \name Gear filters
+ * Filter between gear sensor samples and gear decision, selected by \ref GEAR_FILTER.
+ * Worst case latency is the time from a stable change of the sensor voltage
+ * to the new gear code, see \ref GEAR_FILTER_LATENCY_US.
+ * @{
+ */
+/// No filter, every sample is decoded. Latency 1 sample.
+#define GEAR_FILTER_NONE 0
+/// Median of the last \ref GEAR_MEDIAN_N samples. Latency (N+1)/2 samples, 3 for N=5.
+#define GEAR_FILTER_MEDIAN 1
+/// First order IIR with coefficient 1/2^\ref GEAR_IIR_SHIFT. Latency ca 0.7*2^shift samples, 3 for shift 2.
+#define GEAR_FILTER_IIR 2
+/// Gear changes after \ref GEAR_CONSECUTIVE_N equal decoded samples. Latency N samples.
+#define GEAR_FILTER_CONSECUTIVE 3
+///@}
+
+#ifndef GEAR_FILTER
+/**
+ * Selected gear filter.
+ * Consecutive samples filter gives no false changes on replayed rides for ca 2ms
+ * more latency. Median removes single glitches, but the sample taken across the
+ * end of the 5V between-gears spike is averaged to a level in between, it becomes
+ * the median of the window and is decoded as another gear. IIR drags the reading
+ * through other gears' levels the same way.
+ */
+#define GEAR_FILTER GEAR_FILTER_CONSECUTIVE
+#endif
+
+/// Number of samples for \ref GEAR_FILTER_MEDIAN. Must be odd, max 9.
+#if ADC_ACQUISITION == ADC_ACQUISITION_FREE
+#define GEAR_MEDIAN_N 5
+#else
+#define GEAR_MEDIAN_N 3
+#endif
+
+/// IIR coefficient shift for \ref GEAR_FILTER_IIR, from 1 to 7.
+#define GEAR_IIR_SHIFT 2
+
+/// Number of equal samples for \ref GEAR_FILTER_CONSECUTIVE.
+#define GEAR_CONSECUTIVE_N 4
+
+/**
+ * Worst case latency of the selected filter in microseconds.
+ */
+#if GEAR_FILTER == GEAR_FILTER_MEDIAN
+#define GEAR_FILTER_LATENCY_US ( (GEAR_MEDIAN_N+1)/2 * ADC_SAMPLE_US )
+#elif GEAR_FILTER == GEAR_FILTER_IIR
+#define GEAR_FILTER_LATENCY_US ( ((1<<GEAR_IIR_SHIFT)*7/10+1) * ADC_SAMPLE_US )
+#elif GEAR_FILTER == GEAR_FILTER_CONSECUTIVE
+#define GEAR_FILTER_LATENCY_US ( GEAR_CONSECUTIVE_N * ADC_SAMPLE_US )
+#else
+#define GEAR_FILTER_LATENCY_US ADC_SAMPLE_US
+#endif
+
+/**
+ * \name Shift tracking
+ * @{
+ */
+/// Number of gear samples in unknown band after which shift is cancelled (250ms)
+#define SHIFT_TIMEOUT ( 250000UL / ADC_SAMPLE_US )
+/// Minimal distance from the gear level, in 8-bit ADC readings, that gives shift direction
+#define SHIFT_DRIFT 2
+/// Number of consecutive samples that confirm shift direction and the shift itself before gear is predicted
+#define SHIFT_CONFIRM_N 3
+///@}
+
+/**
+ * Enable adaptive gear sampling rate, see AdcFrame(). Sampling pauses between
+ * scheduler cycles while gear signal is stable. Not available with
+ * \ref ADC_ACQUISITION_SLEEP, conversions pace display and \ref g_Ticks there.
+ */
+#define GEAR_ADAPTIVE_RATE
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+#undef GEAR_ADAPTIVE_RATE
+#endif
+
+/**
+ * \name Adaptive sampling rate
+ * Pause is counted in display frames (\ref DISPLAY_FRAME_US), rates between
+ * full rate and rate with one frame pause are rounded.
+ * @{
+ */
+/// Gear sample rate when signal moves [Hz], full rate if it is higher than 1/\ref ADC_SAMPLE_US
+#define GEAR_RATE_MAX_HZ 1000
+/// Gear sample rate when signal is stable [Hz], the shortest unknown band during shift must get several samples
+#define GEAR_RATE_MIN_HZ 100
+/// Difference of consecutive samples, in 8-bit ADC readings, which means moving signal
+#define GEAR_ACTIVE_DELTA 2
+/// Number of quiet samples at the high rate before the rate drops
+#define GEAR_QUIET_SAMPLES 32
+/// Pause after every scheduler cycle in display frames for sample rate \a hz
+#define GEAR_RATE_PAUSE(hz) ( 1000000UL/(hz) > ADC_SAMPLE_US + DISPLAY_FRAME_US/2 ? \
+	(1000000UL/(hz) - ADC_SAMPLE_US + DISPLAY_FRAME_US/2) / DISPLAY_FRAME_US : 0 )
+///@}
+
+/**
+ * Enable online calibration of gear levels, see CalibrateGears().
+ * Demo and digital decoders have no sensor levels to follow.
+ */
+#define GEAR_CALIBRATION
+#if GEAR_DECODER == GEAR_DECODER_DEMO || GEAR_DECODER == GEAR_DECODER_DIGITAL
+#undef GEAR_CALIBRATION
+#endif
+
+/**
+ * \name Gear calibration
+ * @{
+ */
+/// Number of stable samples in one calibration block, sum of the block fits in 16 bits
+#define CALIB_SAMPLES ( 1 << (16-GEAR_BITS) )
+/// Centroid and spread filter coefficient 1/2^shift, in blocks
+#define CALIB_SHIFT 6
+/// Level is not adjusted if spread of samples is higher, in 8-bit ADC readings
+#define CALIB_MAX_SPREAD 6
+/// Minimal distance between adjacent levels, in 8-bit ADC readings
+#define CALIB_MIN_GAP 8
+/// Number of blocks between checks if levels must be stored in EEPROM (10 minutes at full rate)
+#define CALIB_SAVE_BLOCKS ( 600000000UL / ((uint32_t)CALIB_SAMPLES * ADC_SAMPLE_US) )
+/// Minimal level change, in 8-bit ADC readings, that is stored in EEPROM
+#define CALIB_SAVE_DELTA 2
+///@}
+
+void InitADC();
+void AdcSleepConvert();
+void AdcFrame();
+void InitGearDecoder();
+uint8_t AdcLatest( uint8_t slot );
+uint8_t AdcAverage( uint8_t slot );
+void BuildGearTable();
+void CalibrateGears();
+uint8_t GearFiltered();
+uint16_t GearSensor();
 uint8_t GetLight();
 uint8_t GetGear();
+uint8_t TopGear();
+uint8_t PredictGear();
 
 #endif /* ADC_H_ */
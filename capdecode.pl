@@ -0,0 +1,142 @@
+#!/bin/perl
+#                          _   _                  _        __
+#   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+#  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+# | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+#  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+#           |_|
+#
+# Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+#
+# THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+# KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+# PARTICULAR PURPOSE.
+
+# Decodes gear signal capture from EEPROM dump
+# See help for more info
+
+sub HELP_MESSAGE
+{
+	print  <<'HELP';
+capdecode.pl eeprom_file
+Decode gear signal capture (capture.c) from EEPROM dump into CSV.
+(c) 2012 aquaticus.info
+
+EEPROM file is Intel HEX or raw binary, e.g. read by
+avrdude -p m88p -c usbasp -U eeprom:r:eeprom.hex:i
+
+Output columns:
+sample  sample number, 0 is the trigger sample
+time_us time from the trigger in microseconds
+raw     gear sensor sample in capture precision
+adc     the same sample as 10-bit ADC reading, gpisim replay input
+neutral neutral line state, 1 = high
+HELP
+
+exit;
+}
+
+use strict;
+
+my $in = $ARGV[0] or HELP_MESSAGE();
+
+# keep in sync with capture.h
+my $BLOCK_SIZE = 16;
+my $NEUTRAL = 0x80;
+my $END = 0x80;
+my $VERSION = 1;
+my %TRIGGER = ( 1 => "unknown band", 2 => "button" );
+
+open FILE, "<$in" or die("Can not open input file $in. $!");
+binmode FILE;
+my $data = do { local $/; <FILE> };
+close(FILE);
+
+my @eeprom;
+
+if( $data =~ /^:/ )
+{
+	# Intel HEX
+	my $base = 0;
+	foreach my $line ( split /\r?\n/, $data )
+	{
+		next unless $line =~ /^:([0-9A-Fa-f]+)$/;
+
+		my @b = map { hex } unpack( "(A2)*", $1 );
+		my ($n, $addr, $type) = ($b[0], $b[1]*256 + $b[2], $b[3]);
+
+		if( $type == 0 )
+		{
+			@eeprom[ $base+$addr .. $base+$addr+$n-1 ] = @b[ 4 .. 4+$n-1 ];
+		}
+		elsif( $type == 2 )
+		{
+			$base = ($b[4]*256 + $b[5]) * 16;
+		}
+		elsif( $type == 1 )
+		{
+			last;
+		}
+	}
+
+	@eeprom = map { defined $_ ? $_ : 0xFF } @eeprom;
+}
+else
+{
+	@eeprom = unpack( "C*", $data );
+}
+
+# find header by magic and version
+my $h;
+for( my $i = 0; $i + 10 <= @eeprom; $i++ )
+{
+	if( $eeprom[$i] == ord('G') && $eeprom[$i+1] == ord('C') && $eeprom[$i+2] == $VERSION )
+	{
+		$h = $i;
+		last;
+	}
+}
+
+die("No capture found in $in") unless defined $h;
+
+my $bits = $eeprom[$h+3];
+my $period = $eeprom[$h+4] + $eeprom[$h+5]*256;
+my $trigger = $eeprom[$h+6];
+my $blocks = $eeprom[$h+7];
+my $tblock = $eeprom[$h+8];
+my $tsample = $eeprom[$h+9];
+
+die("Capture truncated") if $h + 10 + $blocks*$BLOCK_SIZE > @eeprom;
+
+# decode blocks
+my @samples;
+my $first; # index of the trigger sample
+for( my $b = 0; $b < $blocks; $b++ )
+{
+	my @blk = @eeprom[ $h+10+$b*$BLOCK_SIZE .. $h+10+($b+1)*$BLOCK_SIZE-1 ];
+	my $neutral = $blk[0] & $NEUTRAL ? 1 : 0;
+	my $value = ($blk[0] & ~$NEUTRAL) * 256 + $blk[1];
+
+	$first = @samples + $tsample if $b == $tblock;
+	push @samples, [ $value, $neutral ];
+
+	for( my $i = 2; $i < $BLOCK_SIZE; $i++ )
+	{
+		last if $blk[$i] == $END;
+
+		$value += $blk[$i] < 0x80 ? $blk[$i] : $blk[$i] - 256;
+		push @samples, [ $value, $neutral ];
+	}
+}
+
+printf "# %d samples, %d-bit, every %dus, trigger: %s\n", scalar(@samples), $bits,
+	$period, $TRIGGER{$trigger} || $trigger;
+print "sample,time_us,raw,adc,neutral\n";
+
+for( my $i = 0; $i < @samples; $i++ )
+{
+	my $n = $i - $first;
+	printf "%d,%d,%d,%d,%d\n", $n, $n * $period, $samples[$i][0],
+		$samples[$i][0] >> ($bits - 10), $samples[$i][1];
+}
@@ -0,0 +1,273 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Gear signal capture
+ */
+
+#include "capture.h"
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+
+#ifdef GEAR_CAPTURE
+
+/**
+ * \defgroup capture Gear signal capture
+ * \brief Recording of raw gear sensor samples around a misread for later analysis.
+ *
+ * Capture records every gear sample and state of the neutral line into a RAM
+ * ring. When the gear sensor stays in unknown band or the rider presses the
+ * button, recording continues for \ref CAPTURE_AFTER_BLOCKS and the ring is
+ * frozen. Main loop stores it in EEPROM by CaptureSave(), the next capture
+ * overwrites it. Use \c capdecode.pl to decode EEPROM dump read by programmer:
+ * \code
+ * avrdude -p m88p -c usbasp -U eeprom:r:eeprom.hex:i
+ * perl capdecode.pl eeprom.hex > capture.csv
+ * \endcode
+ * @{
+ */
+
+/**
+ * \name Capture states
+ * @{
+ */
+/// Not recording
+#define CAPTURE_OFF 0
+/// Recording, waiting for trigger
+#define CAPTURE_RECORD 1
+/// Recording after trigger
+#define CAPTURE_AFTER 2
+/// Ring frozen, waiting for CaptureSave()
+#define CAPTURE_READY 3
+///@}
+
+/**
+ * Ring of delta encoded blocks.
+ *
+ * The first two bytes of a block are the first sample, big endian, with
+ * \ref CAPTURE_NEUTRAL flag in the upper byte. Every next byte is signed
+ * difference from the previous sample. Block is closed early if the difference
+ * does not fit in a byte or the neutral line changes, its rest is filled with
+ * \ref CAPTURE_END. Every block can be decoded alone.
+ */
+static uint8_t CaptureRing[ CAPTURE_BLOCKS ][ CAPTURE_BLOCK_SIZE ];
+
+/// Current state, e.g. \ref CAPTURE_RECORD
+static volatile uint8_t CaptureState;
+/// Block being written
+static uint8_t CaptureBlock;
+/// Next free byte in the block being written
+static uint8_t CapturePos;
+/// Number of written blocks, up to \ref CAPTURE_BLOCKS
+static uint8_t CaptureUsed;
+/// Blocks to record after trigger
+static uint8_t CaptureLeft;
+/// Previous sample
+static uint16_t CapturePrev;
+/// Neutral line state of the block being written
+static uint8_t CaptureNeutral;
+/// Number of unknown gear samples after a known one
+static uint8_t CaptureUnknown;
+/// Header of the frozen capture
+static CAPTURE_HEADER CaptureHeader;
+
+/**
+ * Layout of capture in EEPROM, 202 bytes.
+ */
+typedef struct
+{
+	CAPTURE_HEADER Header; ///< Header
+	uint8_t Ring[ CAPTURE_BLOCKS ][ CAPTURE_BLOCK_SIZE ]; ///< Blocks, the oldest first
+} CAPTURE_EEPROM;
+
+/** Capture in EEPROM, written by CaptureSave() */
+static CAPTURE_EEPROM EEMEM ee_Capture;
+
+/**
+ * \brief Starts recording.
+ *
+ * Capture runs in background, gear display works as usual. Adaptive sampling
+ * rate is held at the full rate while recording.
+ */
+void CaptureStart()
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		CaptureUsed = 0;
+		CapturePos = CAPTURE_BLOCK_SIZE; //the first sample opens a block
+		CaptureBlock = CAPTURE_BLOCKS-1;
+		CaptureUnknown = CAPTURE_UNKNOWN_SAMPLES; //wait for a known gear
+		CaptureState = CAPTURE_RECORD;
+	}
+}
+
+/**
+ * \brief Stops recording, nothing is stored.
+ */
+void CaptureStop()
+{
+	CaptureState = CAPTURE_OFF;
+}
+
+/**
+ * \brief Checks if capture is recording or waiting for CaptureSave().
+ * \return Non zero if capture is running.
+ */
+uint8_t CaptureRunning()
+{
+	return CAPTURE_OFF != CaptureState;
+}
+
+/**
+ * \brief Marks the latest sample as the trigger.
+ *
+ * Ignored if trigger was already set or nothing is recorded yet.
+ *
+ * \param trigger Trigger code, e.g. \ref CAPTURE_TRIGGER_UNKNOWN.
+ */
+static inline void Trigger( uint8_t trigger )
+{
+	if( CAPTURE_RECORD == CaptureState && CaptureUsed )
+	{
+		CaptureHeader.Trigger = trigger;
+		CaptureHeader.TriggerBlock = CaptureBlock;
+		CaptureHeader.TriggerSample = CapturePos - 2;
+		CaptureLeft = CAPTURE_AFTER_BLOCKS;
+		CaptureState = CAPTURE_AFTER;
+	}
+}
+
+/**
+ * \brief Triggers capture by button.
+ */
+void CaptureTrigger()
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		Trigger( CAPTURE_TRIGGER_BUTTON );
+	}
+}
+
+/**
+ * \brief Records one gear sample.
+ *
+ * Called from ADC interrupt for every gear sample, before any filter. Costs
+ * ca 40 cycles, 100 when a block is opened.
+ *
+ * \param value Gear sensor sample, \ref GEAR_BITS precision.
+ * \param neutral State of \ref NEUTRAL_PIN read as digital input, non zero if high.
+ * \param unknown Non zero if the sample is in unknown band.
+ * \return Non zero if capture records, sampling rate must not drop.
+ */
+uint8_t CaptureSample( uint16_t value, uint8_t neutral, uint8_t unknown )
+{
+	if( CAPTURE_RECORD != CaptureState && CAPTURE_AFTER != CaptureState )
+		return 0;
+
+	int16_t delta = value - CapturePrev;
+	uint8_t* p = CaptureRing[ CaptureBlock ];
+
+	neutral = neutral ? CAPTURE_NEUTRAL : 0;
+
+	if( CapturePos >= CAPTURE_BLOCK_SIZE || neutral != CaptureNeutral || delta > 127 || delta < -127 )
+	{
+		while( CapturePos < CAPTURE_BLOCK_SIZE )
+			p[ CapturePos++ ] = CAPTURE_END;
+
+		if( CAPTURE_AFTER == CaptureState && !--CaptureLeft )
+		{
+			CaptureState = CAPTURE_READY;
+			return 0;
+		}
+
+		if( ++CaptureBlock >= CAPTURE_BLOCKS )
+			CaptureBlock = 0;
+
+		if( CaptureUsed < CAPTURE_BLOCKS )
+			CaptureUsed++;
+
+		p = CaptureRing[ CaptureBlock ];
+		p[0] = neutral | (value >> 8);
+		p[1] = value;
+		CapturePos = 2;
+		CaptureNeutral = neutral;
+	}
+	else
+	{
+		p[ CapturePos++ ] = delta;
+	}
+
+	CapturePrev = value;
+
+	if( !unknown )
+		CaptureUnknown = 0;
+	else if( CaptureUnknown < CAPTURE_UNKNOWN_SAMPLES && ++CaptureUnknown == CAPTURE_UNKNOWN_SAMPLES )
+		Trigger( CAPTURE_TRIGGER_UNKNOWN );
+
+	return 1;
+}
+
+/**
+ * \brief Stores frozen capture in EEPROM.
+ *
+ * Called from the main loop. Only changed bytes are written, it may take up to
+ * 0.7s. Display is refreshed by interrupt in the meantime.
+ *
+ * \return Non zero if capture was stored, recording is stopped.
+ */
+uint8_t CaptureSave()
+{
+	if( CAPTURE_READY != CaptureState )
+		return 0;
+
+	//the oldest block
+	uint8_t first = CaptureUsed < CAPTURE_BLOCKS ? 0 : CaptureBlock+1;
+	if( first >= CAPTURE_BLOCKS )
+		first = 0;
+
+	CaptureHeader.Magic[0] = 'G';
+	CaptureHeader.Magic[1] = 'C';
+	CaptureHeader.Version = CAPTURE_VERSION;
+	CaptureHeader.Bits = GEAR_BITS;
+	CaptureHeader.SampleUs = ADC_SAMPLE_US;
+	CaptureHeader.Blocks = CaptureUsed;
+	CaptureHeader.TriggerBlock -= first;
+	if( CaptureHeader.TriggerBlock >= CAPTURE_BLOCKS )
+		CaptureHeader.TriggerBlock += CAPTURE_BLOCKS;
+
+	//invalid magic while blocks are written
+	eeprom_update_byte( &ee_Capture.Header.Magic[0], 0xFF );
+
+	for( uint8_t i = 0; i < CaptureUsed; i++ )
+	{
+		eeprom_update_block( CaptureRing[ first ], ee_Capture.Ring[ i ], CAPTURE_BLOCK_SIZE );
+
+		if( ++first >= CAPTURE_BLOCKS )
+			first = 0;
+	}
+
+	eeprom_update_block( &CaptureHeader, &ee_Capture.Header, sizeof(CAPTURE_HEADER) );
+
+	CaptureState = CAPTURE_OFF;
+
+	return 1;
+}
+
+/** @} */
+
+#endif
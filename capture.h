@@ -0,0 +1,104 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Gear signal capture header
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+#include "adc.h"
+
+/**
+ * Enable raw gear signal capture, see CaptureStart().
+ * Ratio decoder has no analog gear signal to capture.
+ */
+#define GEAR_CAPTURE
+#if GEAR_DECODER == GEAR_DECODER_RATIO
+#undef GEAR_CAPTURE
+#endif
+
+/**
+ * \name Capture ring
+ * Samples are delta encoded in blocks, every block starts with full sample,
+ * see CaptureSample().
+ * @{
+ */
+/// Size of one block in bytes, 2 bytes of the first sample and up to 14 deltas
+#define CAPTURE_BLOCK_SIZE 16
+/// Number of blocks in RAM and EEPROM, ca 160 samples
+#define CAPTURE_BLOCKS 12
+/// Number of blocks from the trigger block to the end, the rest is history before the trigger
+#define CAPTURE_AFTER_BLOCKS ( CAPTURE_BLOCKS/2 )
+/// Flag of the first byte of block, neutral line is high in the whole block
+#define CAPTURE_NEUTRAL 0x80
+/// Delta that marks unused end of block
+#define CAPTURE_END 0x80
+///@}
+
+/**
+ * Time the gear sensor stays in unknown band after a known gear to trigger
+ * capture [us]. Longer than the spike of a clean shift, shorter than
+ * \ref SHIFT_TIMEOUT.
+ */
+#define CAPTURE_UNKNOWN_US 50000UL
+
+/// Number of unknown gear samples that trigger capture, max 255
+#define CAPTURE_UNKNOWN_SAMPLES ( CAPTURE_UNKNOWN_US / ADC_SAMPLE_US )
+
+/**
+ * \name Capture triggers
+ * Stored in \ref CAPTURE_HEADER.Trigger.
+ * @{
+ */
+/// Gear sensor in unknown band for \ref CAPTURE_UNKNOWN_US
+#define CAPTURE_TRIGGER_UNKNOWN 1
+/// Button pressed
+#define CAPTURE_TRIGGER_BUTTON 2
+///@}
+
+/// Version of stored capture, \ref CAPTURE_HEADER.Version
+#define CAPTURE_VERSION 1
+
+/**
+ * Header of capture stored in EEPROM. Blocks of \ref CAPTURE_BLOCK_SIZE follow
+ * the header, the oldest first.
+ * Multi-byte values are little endian.
+ */
+typedef struct tagCaptureHeader
+{
+	uint8_t Magic[2]; ///< 'G','C', the host script finds capture in EEPROM dump by it
+	uint8_t Version; ///< \ref CAPTURE_VERSION
+	uint8_t Bits; ///< Precision of samples, \ref GEAR_BITS
+	uint16_t SampleUs; ///< Sampling period in microseconds, \ref ADC_SAMPLE_US
+	uint8_t Trigger; ///< What triggered capture, e.g. \ref CAPTURE_TRIGGER_UNKNOWN
+	uint8_t Blocks; ///< Number of stored blocks
+	uint8_t TriggerBlock; ///< Block with the trigger sample
+	uint8_t TriggerSample; ///< Index of the trigger sample in the block, 0 is the first sample
+} CAPTURE_HEADER;
+
+void CaptureStart();
+void CaptureStop();
+uint8_t CaptureRunning();
+void CaptureTrigger();
+uint8_t CaptureSample( uint16_t value, uint8_t neutral, uint8_t unknown );
+uint8_t CaptureSave();
+
+#endif /* CAPTURE_H_ */
@@ -23,6 +23,7 @@
 
 #include <util/delay.h>
 #include "display.h"
+#include "adc.h"
 
 /**
  * \file
@@ -57,15 +58,44 @@ uint8_t EEMEM ee_ConfigCRC=0xAB; //0xAB = invalid crc (NOT 00, it's good CRC for
  * Start-up message on display.
  * Modify to whatever you like.
  */
-uint8_t EEMEM ee_Message[64] = " AQUATICUS.INFO";
+uint8_t EEMEM ee_Message[MESSAGE_SIZE] = " AQUATICUS.INFO";
 
 /** Configuration in RAM */
 CONFIGURATION g_Config;
 
+#if GEAR_DECODER == GEAR_DECODER_RATIO
+/**
+ * Default gear levels, ratios for Suzuki DL650 '04 with one engine pulse per
+ * crankshaft and one wheel pulse per wheel revolution.
+ * Level is \ref RATIO_SCALE / (primary 2.088 * final 3.066 * gear ratio),
+ * gear ratios 2.461, 1.777, 1.380, 1.125, 0.961 and 0.851.
+ * Higher ratio (clutch pulled at speed) is unknown position.
+ */
+static const uint16_t DefaultLevel[ MAX_GEAR_NUMBER ] PROGMEM =
+{
+	GEAR_LEVEL(65), GEAR_LEVEL(90), GEAR_LEVEL(116),
+	GEAR_LEVEL(142), GEAR_LEVEL(166), GEAR_LEVEL(188)
+};
+/// Default \ref CONFIGURATION.UnknownLevel, gear gap above the last gear
+#define DEFAULT_UNKNOWN_LEVEL GEAR_LEVEL(212)
+#else
+/**
+ * Default gear levels, real values for Suzuki DL650 '04.
+ */
+static const uint16_t DefaultLevel[ MAX_GEAR_NUMBER ] PROGMEM =
+{
+	GEAR_LEVEL(77), GEAR_LEVEL(97), GEAR_LEVEL(136),
+	GEAR_LEVEL(174), GEAR_LEVEL(210), GEAR_LEVEL(236)
+};
+/// Default \ref CONFIGURATION.UnknownLevel, sensor reading between gears
+#define DEFAULT_UNKNOWN_LEVEL GEAR_LEVEL(254)
+#endif
+
 /**
  * \brief Reads configuration data from EEPROM.
  * Checks CRC of config data in EEPROM. Validates CRC and use default values in case of
- * damaged data.
+ * damaged data. Default values are used also if gear levels were stored
+ * in other precision than \ref GEAR_BITS (firmware with other \ref ADC_ACQUISITION).
  *
  * \note If macro DISABLE_EEPROM_CONFIG is defined default parameters are used (not read from flash).
  *
@@ -83,22 +113,17 @@ inline void ReadConfig()
 	//compute CRC
 	uint8_t crc = crc8((uint8_t*)&g_Config, sizeof(CONFIGURATION) );
 
-	if( crc != eeCRC )
+	if( crc != eeCRC || g_Config.LevelBits != GEAR_BITS )
 	{
-		//invalid data in EEPROM (mostly EEPROM is empty)
+		//invalid data in EEPROM (mostly EEPROM is empty) or levels in other precision
 		//use default data
 		memset( &g_Config, 0, sizeof(CONFIGURATION));
 
-		//real values for Suzuki DL650 '04
+		g_Config.LevelBits = GEAR_BITS;
 		g_Config.MaxGearNumber = MAX_GEAR_NUMBER;
-		g_Config.GearLevel[0] = 77;
-		g_Config.GearLevel[1] = 97;
-		g_Config.GearLevel[2] = 136;
-		g_Config.GearLevel[3] = 174;
-		g_Config.GearLevel[4] = 210;
-		g_Config.GearLevel[5] = 236;
+		memcpy_P( g_Config.GearLevel, DefaultLevel, sizeof(DefaultLevel) );
 
-		g_Config.UnknownLevel = 254;
+		g_Config.UnknownLevel = DEFAULT_UNKNOWN_LEVEL;
 
 		WriteConfig();
 		ledPutc('W');
@@ -106,33 +131,33 @@ inline void ReadConfig()
 #else
 	//default config (not from EEPROM)
 	memset( &g_Config, 0, sizeof(CONFIGURATION));
+	g_Config.LevelBits = GEAR_BITS;
 	g_Config.MaxGearNumber = MAX_GEAR_NUMBER;
-
-	//real values for Suzuki DL650 '04
-	g_Config.GearLevel[0] = 77;
-	g_Config.GearLevel[1] = 97;
-	g_Config.GearLevel[2] = 136;
-	g_Config.GearLevel[3] = 174;
-	g_Config.GearLevel[4] = 210;
-	g_Config.GearLevel[5] = 236;
-	g_Config.UnknownLevel = 254;
+	memcpy_P( g_Config.GearLevel, DefaultLevel, sizeof(DefaultLevel) );
+	g_Config.UnknownLevel = DEFAULT_UNKNOWN_LEVEL;
 
 #endif
 
+	BuildGearTable();
 }
 
 /**
  * Store configuration data in EEPROM. CRC is computed.
- * \note If macro DISABLE_EEPROM_CONFIG is defined function does nothing.
+ * Only bytes that differ are written, periodic save of calibrated gear levels
+ * does not wear out unchanged cells.
+ * Gear lookup table is rebuilt, so this function must be called after every change of \ref g_Config.
+ * \note If macro DISABLE_EEPROM_CONFIG is defined function only rebuilds gear lookup table.
  */
 void WriteConfig()
 {
+	BuildGearTable();
+
 #ifndef DISABLE_EEPROM_CONFIG
 	uint8_t crc = crc8( (uint8_t*)&g_Config, sizeof(CONFIGURATION) );
 
-	eeprom_write_block( &g_Config, &ee_Config, sizeof(CONFIGURATION) );
+	eeprom_update_block( &g_Config, &ee_Config, sizeof(CONFIGURATION) );
 
-	eeprom_write_byte(&ee_ConfigCRC, crc);
+	eeprom_update_byte(&ee_ConfigCRC, crc);
 #endif
 }
 
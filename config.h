@@ -55,7 +55,8 @@
 
 /**
  * \name Menu scroll speed
- * Delay in milliseconds affecting menu scrolling speed.
+ * Time in milliseconds of moving text by one pixel, selected by
+ * CONFIGURATION.ScrollingSpeed. See ScrollDelay().
  * @{
  */
 #define SCROLL_SLOW_MS 40
@@ -64,7 +65,16 @@
 /**@}*/
 
 /**
- * Maximum number of gears including neutral.
+ * Size of the startup message in EEPROM, including terminating 0.
+ * Message without terminating 0 ends after \ref MESSAGE_SIZE characters.
+ */
+#define MESSAGE_SIZE 128
+
+/**
+ * Maximum number of gear levels in \ref CONFIGURATION.GearLevel.
+ * Decoders with neutral indicator use all levels for gears (6 gears),
+ * \ref GEAR_DECODER_LADDER stores neutral in the first level, so it decodes
+ * neutral and up to 5 gears (N+5). See TopGear().
  */
 #define MAX_GEAR_NUMBER 6
 
@@ -75,6 +85,7 @@
  *
  * \warning Default values are set to 0 in case of EEPROM corruption.
  * Every new entry in config should assume its default value as 0.
+ * \a LevelBits is the only exception, it must be \ref GEAR_BITS.
  */
 
 typedef struct tagConfiguration
@@ -96,12 +107,15 @@ typedef struct tagConfiguration
 
 	uint8_t MaxGearNumber; ///< Number of gears
 
-	uint8_t UnknownLevel; ///< ADC reading for unknown gear position
+	uint16_t UnknownLevel; ///< Gear sensor reading for unknown gear position, \ref GEAR_BITS precision
+
+	uint16_t GearLevel[MAX_GEAR_NUMBER]; ///< Voltage levels for gears, \ref GEAR_BITS precision
 
-	uint8_t GearLevel[MAX_GEAR_NUMBER]; ///< Voltage levels for gears
+	uint8_t LevelBits; ///< Precision of stored levels, configuration of build with other \ref GEAR_BITS is not used
 } CONFIGURATION;
 
 extern CONFIGURATION g_Config;
+extern CONFIGURATION ee_Config;
 extern uint8_t ee_Message[];
 
 void ReadConfig();
@@ -25,6 +25,28 @@
 
 #include <stdint.h>
 
+/**
+ * \name CRC8 implementations
+ * Selected by \ref CRC8_IMPLEMENTATION. Flash size and speed per byte are
+ * estimates for avr-gcc -Os.
+ * @{
+ */
+/// Bit by bit, no table. ~30 bytes, ~90 cycles per byte.
+#define CRC8_BITWISE 0
+/// Two lookups in 16 byte table. ~50 bytes, ~30 cycles per byte.
+#define CRC8_NIBBLE 1
+/// One lookup in 256 byte table. ~270 bytes, ~12 cycles per byte.
+#define CRC8_TABLE 2
+///@}
+
+#ifndef CRC8_IMPLEMENTATION
+/**
+ * Selected CRC8 implementation.
+ */
+#define CRC8_IMPLEMENTATION CRC8_NIBBLE
+#endif
+
+uint8_t crc8_update( uint8_t crc, uint8_t data );
 uint8_t crc8( uint8_t* pData, uint16_t len );
 
 #endif
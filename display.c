@@ -22,12 +22,15 @@
 
 #include "display.h"
 #include "config.h"
+#include "gpi.h"
+#include "adc.h"
 #include <stdint.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <util/delay.h>
+#include <util/atomic.h>
 #include <string.h>
 #include "button.h"
-#include <avr/eeprom.h>
 
 /**
  * \defgroup display Display
@@ -80,6 +83,33 @@ uint8_t g_TextBufferLen = 0;
 /// From 0 (dark) to 15 (bright).
 volatile uint8_t g_LedBrightness = BRIGHTNESS_MAX;
 
+/**
+ * \brief System time base.
+ *
+ * Incremented by display interrupt on every timer0 overflow,
+ * \ref TICKS_PER_SECOND times per second. Wraps around every ca 2s.
+ *
+ * \sa GetTicks()
+ */
+volatile uint16_t g_Ticks;
+
+/**
+ * \brief Returns current value of \ref g_Ticks.
+ *
+ * \return Number of ticks. Only the difference between two readings is meaningful.
+ */
+uint16_t GetTicks()
+{
+	uint16_t t;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		t = g_Ticks;
+	}
+
+	return t;
+}
+
 /**
  * \brief Swap bits in byte to match hardware configuration.
  *
@@ -271,10 +301,7 @@ void ShiftUp( uint8_t offset, PGM_P OldData, PGM_P NewData )
 		DisplayBuffer[y++] = pgm_read_byte( NewData+i );
 	}
 
-//	if( offset <= 8 )
-//		DisplayBuffer[y++] = 0;
-
-	for(uint8_t i=0;i<offset-1;i++)
+	for(uint8_t i=0;i<offset;i++)
 	{
 		DisplayBuffer[y++] = pgm_read_byte( OldData+i );
 	}
@@ -342,6 +369,51 @@ int ScrollLeft( const char* szText, int Len, int* pOffset )
 	return *pOffset;
 }
 
+/**
+ * Scrolls text from right to left. Text is read from the stream
+ * character by character, so it does not have to be stored in RAM.
+ *
+ * \param pText Text stream. It is rewound when \a pOffset is 0.
+ *
+ * \param pOffset Offset in pixels, from 0 to 8 * length of the text.
+ *
+ * \return New offset value. 0 at the end of the text.
+ *
+ * \sa ScrollLeft() TextOpen()
+ */
+int ScrollLeftText( TEXTSTREAM* pText, int* pOffset )
+{
+	int c = *pOffset / 8;
+
+	if( 0 == *pOffset )
+	{
+		TextRewind( pText );
+		pText->Cur = TextGetc( pText );
+		pText->Next = pText->Cur ? TextGetc( pText ) : 0;
+	}
+
+	while( pText->Index < c && pText->Cur )
+	{
+		pText->Cur = pText->Next;
+		pText->Next = pText->Cur ? TextGetc( pText ) : 0;
+		pText->Index++;
+	}
+
+	if( 0 == pText->Cur )
+	{
+		*pOffset = 0;
+		return *pOffset;
+	}
+
+	char c2 = pText->Next ? pText->Next : ' '/*extra space at the end*/;
+
+	ShiftLeft( *pOffset % 8, pCurrentFont+pText->Cur*8, pCurrentFont+c2*8 );
+
+	(*pOffset)++;
+
+	return *pOffset;
+}
+
 /**
  * \brief Scrolls test upwards.
  * \param szText Text to scroll. NULL at the end is not required.
@@ -393,6 +465,86 @@ int ScrollDown( const char* szText, int Len, int* pOffset )
 	return *pOffset;
 }
 
+/**
+ * \brief Returns time of one scrolling step.
+ *
+ * \return Time in milliseconds of moving text by one pixel,
+ * based on \a g_Config.ScrollingSpeed.
+ */
+static uint8_t ScrollPeriod()
+{
+	switch( g_Config.ScrollingSpeed )
+	{
+	case CONF_SCROLL_SLOW:
+		return SCROLL_SLOW_MS;
+
+	case CONF_SCROLL_FAST:
+		return SCROLL_FAST_MS;
+
+	default:
+	case CONF_SCROLL_NORMAL:
+		return SCROLL_NORMAL_MS;
+	}
+}
+
+/**
+ * \brief Waits for the next scrolling step.
+ *
+ * Text moves with constant velocity of 1000/\a ms pixels per second, where
+ * \a ms is one of the \ref SCROLL_NORMAL_MS values selected by \a g_Config.ScrollingSpeed.
+ * Time is measured with \ref g_Ticks, so the speed does not depend on time spent
+ * in interrupts or in the caller's loop. Fraction of the pixel is carried over
+ * to the next step.
+ *
+ * If the caller is late by more than one pixel, \a pOffset is advanced
+ * to keep the speed.
+ *
+ * \param[in,out] pOffset Offset used by ScrollLeft(). Timing is restarted
+ * for the first pixel of the text (offset 1).
+ *
+ * \par Example
+ * \code
+ * do
+ * {
+ * 	ScrollLeft( test, sizeof(test)-1, &offset);
+ * 	ScrollDelay( &offset );
+ * } while( offset );
+ * \endcode
+ */
+void ScrollDelay( int* pOffset )
+{
+	static uint16_t LastTick;
+	static uint32_t Phase; //[ticks*1000]
+
+	//time of one pixel [ticks*1000]
+	const uint32_t Period = (uint32_t)ScrollPeriod() * TICKS_PER_SECOND;
+	uint16_t now;
+
+	if( *pOffset <= 1 )
+	{
+		LastTick = GetTicks();
+		Phase = 0;
+	}
+
+	do
+	{
+		sleep_mode(); //wake up on the next display interrupt
+
+		now = GetTicks();
+		Phase += (uint32_t)(uint16_t)(now - LastTick) * 1000;
+		LastTick = now;
+	} while( Phase < Period );
+
+	Phase -= Period;
+
+	//skip pixels if the caller was too slow
+	while( Phase >= Period && *pOffset )
+	{
+		Phase -= Period;
+		(*pOffset)++;
+	}
+}
+
 ///@}
 
 /**
@@ -476,31 +628,28 @@ void ledNegPutc( char c /** ASCII code */)
 /**
  * Display text stored in EEPROM memory using current font.
  *
- * \param szText Text to display in EEPROM. Must be terminated by 0 or 0xFF.
+ * Text is read from EEPROM while scrolling, it is not copied to RAM.
+ *
+ * \param szText Text to display in EEPROM. Ends at 0, 0xFF or after \a size bytes.
+ * \param size Size of the EEPROM block, at most 255 bytes.
  *
  * \retval BUTTON_SHORT Button pressed short
  * \retval BUTTON_LONG Button pressed long
  * \retval BUTTON_NONE Timeout
  */
-uint8_t ledPuts_EE( const uint8_t* szText )
+uint8_t ledPuts_EE( const uint8_t* szText, uint8_t size )
 {
 	int offset = 0;
 	uint8_t key;
+	TEXTSOURCE src = { TEXT_EE, (const char*)szText, size };
+	TEXTSTREAM text;
 
-	//copy data from EEPROM
-	for(g_TextBufferLen=0;g_TextBufferLen<TEXTBUFFER_SIZE;g_TextBufferLen++)
-	{
-		g_TextBuffer[g_TextBufferLen] = eeprom_read_byte( szText + g_TextBufferLen ); //read byte from eeprom
-		if( 0 == g_TextBuffer[g_TextBufferLen] || 0xFF /*EEPROM not programmed*/ == g_TextBuffer[g_TextBufferLen] )
-		{
-			break; //end of string
-		}
-	}
+	TextOpen( &text, &src, 1 );
 
 	//scroll once entire text
 	do
 	{
-		ScrollLeft(g_TextBuffer, g_TextBufferLen, &offset );
+		ScrollLeftText( &text, &offset );
 
 		key = ButtonCheck();
 		if( key == BUTTON_SHORT || key == BUTTON_LONG )
@@ -508,7 +657,7 @@ uint8_t ledPuts_EE( const uint8_t* szText )
 			return key;
 		}
 
-		_delay_ms(20);
+		ScrollDelay( &offset );
 
 	} while( offset );
 
@@ -632,7 +781,7 @@ void AnimateVertical(uint8_t prev, uint8_t gear)
  */
 void AnimateNone( uint8_t gear )
 {
-	ledPutc(32+gear);
+	ledPutc(SYMBOL_GEAR_NUMBER+gear);
 }
 
 /**
@@ -683,9 +832,24 @@ ISR(TIMER0_OVF_vect)
 	static uint8_t row=0;
 	static uint8_t pwm=0;
 
+#if ADC_ACQUISITION == ADC_ACQUISITION_TRIGGER
+	//arm ADC auto trigger in the dark step of the row, must be done before
+	//compare match, so it is the first statement, see ADC_TRIGGER_OCR
+	if( 0 == pwm && row < 8 )
+		TIFR0 = _BV( OCF0A );
+#endif
+
 	PORTB = 0; //disable display
 	PORTD = 0;
 
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+	//convert analog input while all LEDs are off, before every row and copy step
+	if( 0 == pwm )
+		AdcSleepConvert();
+#endif
+
+	g_Ticks++;
+
 	//an extra cycle to copy data and read light sensor
 	if( row >= 8 )
 	{
@@ -709,6 +873,10 @@ ISR(TIMER0_OVF_vect)
 			break;
 		}
 
+#ifdef GEAR_ADAPTIVE_RATE
+		AdcFrame();
+#endif
+
 		g_LedBrightness = g_Config.fAutoBrightnessOff ? BRIGHTNESS_MAX : 1-GetLight()/16;
 
 		if( g_LedBrightness < g_Config.MinBrightness*3 )//3 -> gives maximum "minimal" brightness 3*3 = 9 (max 15)
@@ -724,7 +892,12 @@ ISR(TIMER0_OVF_vect)
 
 	PORTB = 1 << row;
 
+#if ADC_ACQUISITION == ADC_ACQUISITION_TRIGGER
+	//the first step of every row stays dark for ADC, the same number of lit steps follows
+	if( pwm && pwm <= (g_LedBrightness % 16) /*brightness level 0-15*/)
+#else
 	if( pwm < (g_LedBrightness % 16) /*brightness level 0-15*/)
+#endif
 	{
 		PORTD = HardwareBuffer[ row ];
 	}
@@ -25,6 +25,7 @@
 
 #include <stdint.h>
 #include <avr/pgmspace.h>
+#include "text.h"
 
 /**
  * \name Symbols in FONTTAB
@@ -63,8 +64,11 @@
 
 /**
  * Maximum size of \a g_TextBuffer;
+ *
+ * Buffer is used only to format temperature. Other texts are read
+ * directly from program memory or EEPROM (see \ref text).
  */
-#define TEXTBUFFER_SIZE 64
+#define TEXTBUFFER_SIZE 12
 
 /**
  * @brief Animation delay in ms.
@@ -76,8 +80,6 @@
 void ledPutc( char c );
 void ledNegPutc( char c );
 
-void ScrollDelay();
-
 extern char g_TextBuffer[];
 extern uint8_t g_TextBufferLen;
 extern PGM_VOID_P pCurrentFont;
@@ -96,13 +98,17 @@ extern unsigned char PROGMEM CHECK[];
 
 extern volatile uint8_t DisplayBuffer[8];
 
+extern volatile uint16_t g_Ticks;
+
+uint16_t GetTicks();
+
 void Animate( uint8_t prev, uint8_t gear );
 
 void DisplayTemperature();
 
 uint8_t GetLight();
 
-void ScrollDelay();
+void ScrollDelay( int* pOffset );
 
 void ShiftLeft( uint8_t offset, PGM_P OldData, PGM_P NewData );
 void ShiftRight( uint8_t offset, PGM_P OldData, PGM_P NewData );
@@ -110,6 +116,7 @@ void ShiftUp( uint8_t offset, PGM_P OldData, PGM_P NewData );
 void ShiftDown( uint8_t offset, PGM_P OldData, PGM_P NewData );
 
 int ScrollLeft( const char* szText, int Len, int* pOffset );
+int ScrollLeftText( TEXTSTREAM* pText, int* pOffset );
 int ScrollUp( const char* szText, int Len, int* pOffset );
 int ScrollDown( const char* szText, int Len, int* pOffset );
 
@@ -117,6 +124,6 @@ void FlashChar(char c, uint8_t n);
 void FlashCharNeg(char c, uint8_t n);
 void AnimateCheck();
 void BrightnessLevel();
-uint8_t ledPuts_EE( const uint8_t* szText );
+uint8_t ledPuts_EE( const uint8_t* szText, uint8_t size );
 
 #endif /* DISPLAY_H_ */
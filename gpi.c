@@ -129,6 +129,8 @@
 #include "temp.h"
 #include "button.h"
 #include "adc.h"
+#include "capture.h"
+#include "stats.h"
 
 /// Program name, date and time of compilation.
 const PROGMEM char REVISION[] = "@(#)GPI " __DATE__ " " __TIME__;
@@ -155,9 +157,9 @@ inline void InitHardware()
 	PORTC = 1 << BUTTON_PIN; //pull-up for button
 	PORTC |= 1 << LIGHT_PIN; //pull-up for phototransistor
 
-	// ADC
-	// Prescaler: 128 division factor that gives 8000000/128 ADC 62kHz clock
-	ADCSRA |= _BV( ADEN ) | _BV(ADPS0) | _BV(ADPS1) | _BV(ADPS2);
+	// ADC, sampled in background by interrupt
+	InitADC();
+	InitGearDecoder();
 
 	//timer0 prescaler
 	TCCR0A = 0; //normal mode
@@ -168,10 +170,37 @@ inline void InitHardware()
 }
 
 
+/**
+ * Period of GearLoop() [ms]. ButtonCheck() and auto temperature timeout
+ * count loop cycles, see ButtonCheck().
+ */
+#define GEAR_LOOP_MS 20
+
+/// \ref GEAR_LOOP_MS in \ref g_Ticks
+#define GEAR_LOOP_TICKS ( (uint16_t)( (uint32_t)GEAR_LOOP_MS * TICKS_PER_SECOND / 1000 ) )
+
+/**
+ * @brief Sleeps until the next cycle of GearLoop().
+ *
+ * Cycles that took longer (e.g. gear animation) are not caught up.
+ *
+ * @param pLast Start of the previous cycle in \ref g_Ticks, updated.
+ */
+static inline void GearLoopWait( uint16_t* pLast )
+{
+	while( (uint16_t)(GetTicks() - *pLast) < GEAR_LOOP_TICKS )
+		sleep_mode(); //wake up on the next display interrupt
+
+	*pLast += GEAR_LOOP_TICKS;
+
+	if( (uint16_t)(GetTicks() - *pLast) >= GEAR_LOOP_TICKS )
+		*pLast = GetTicks();
+}
+
 /**
  * @brief Main loop for displaying gear number.
  *
- * Temperature conversion is initiated every 5s
+ * Temperature is measured in background. Loop runs every \ref GEAR_LOOP_MS.
  *
  * @retval 0 The button was pressed shortly
  * @retval 1 The button was pressed for long time.
@@ -180,13 +209,14 @@ inline void InitHardware()
 
 inline uint8_t GearLoop()
 {
-	const uint8_t LoopTime = 54; //[ms]
+	const uint8_t LoopTime = GEAR_LOOP_MS; //[ms]
 
 	uint8_t gear;
 	uint8_t b;
 	uint8_t prev_gear;
 	uint16_t display_counter=0;
-	uint16_t timeout; //number of cycles per one minute
+	uint16_t timeout; //number of loop cycles to show temperature
+	uint16_t last = GetTicks();
 
 	//display initially gear number without any animation
 	gear = prev_gear = GetGear();
@@ -194,7 +224,7 @@ inline uint8_t GearLoop()
 
 	//{PSTR("Auto Temp|30sec|10sec|1min|OFF"), &g_Config.fTempSmartDisplayTimeout},
 	//timeout
-	//1 loop cycle is about 180ms
+	//1 loop cycle is GEAR_LOOP_MS, longer with gear animation
 	switch( g_Config.fTempSmartDisplayTimeout )
 	{
 		default:
@@ -218,22 +248,42 @@ inline uint8_t GearLoop()
 
 	do
 	{
+		GearLoopWait( &last );
+
 		b = ButtonCheck();
 		if( b == BUTTON_SHORT || b == BUTTON_LONG )
 			return b;
 
 		//display temperature if auto-temp enabled
-		if( timeout && (gear == 0 || gear == g_Config.MaxGearNumber) &&
+		if( timeout && (gear == 0 || gear == TopGear()) &&
 				display_counter > timeout )
 		{
 			return BUTTON_TEMP_MODE;
 		}
 
-		//initialize temperature conversion
-		StartTempConversion();
+		//measure temperature in background
+		UpdateTemperature();
+
+		//follow drift of gear sensor levels
+		CalibrateGears();
+
+#ifdef GEAR_CAPTURE
+		//store frozen capture window
+		if( CaptureSave() )
+		{
+			FlashCharNeg('R',3);
+			ledPutc(SYMBOL_GEAR_NUMBER+prev_gear);
+		}
+#endif
 
+		//during shift start animation to the predicted gear,
+		//GetGear() confirms or cancels it when the shift ends
+		gear = PredictGear();
+		if( GEAR_UNKNOWN == gear )
+			gear = GetGear();
 
-		gear = GetGear(); //takes 20ms
+		//count time in gear
+		StatsGear( gear );
 
 		if( prev_gear != gear )
 		{
@@ -242,7 +292,7 @@ inline uint8_t GearLoop()
 			prev_gear = gear;
 		}
 
-		if( gear == 0 || gear == g_Config.MaxGearNumber )
+		if( gear == 0 || gear == TopGear() )
 			display_counter++;
 		else
 			display_counter = 0;
@@ -264,24 +314,27 @@ static inline uint8_t TemperatureLoop()
 {
 	uint8_t gear;
 	uint8_t b;
+	uint8_t sensor = 0;
 	int offset=0;
 
 	pCurrentFont = FONTTAB;
 
 	while(1)
 	{
-		//get the last conversion result
-		if( GetTempConversionResult() )
-			g_nTemperature = INVALID_TEMP;
+		//the last conversion result, sensors in turn
+		if( sensor >= TempSensors() )
+			sensor = 0;
 
-		FormatTemperature();
+		FormatTemperature( sensor++ );
 
 		do
 		{
-			gear = GetGear(); //=20ms
+			gear = GetGear(); //non-blocking, loop is paced by ScrollDelay()
+
+			StatsGear( gear );
 
 			//if driver changed gear exit
-			if( gear != 0 && gear != g_Config.MaxGearNumber)
+			if( gear != 0 && gear != TopGear() )
 				return BUTTON_GEAR_MODE;
 
 			b = ButtonCheck();
@@ -289,17 +342,14 @@ static inline uint8_t TemperatureLoop()
 			if( b == BUTTON_SHORT || b == BUTTON_LONG )
 				return b;
 
+			UpdateTemperature();
+
 			//scroll temp
 			ScrollLeft(g_TextBuffer, g_TextBufferLen, &offset);
 
-			SCROLL_DELAY;
+			ScrollDelay( &offset );
 
 		} while( offset );
-
-		//Initiate temperature conversion
-		//conversion takes 750ms
-		//(it can be called more often then 750ms)
-		StartTempConversion();
 	}
 
 	return BUTTON_GEAR_MODE;
@@ -352,6 +402,7 @@ int main()
 	uint8_t key;
 
 	ReadConfig();
+	StatsRead();
 
 	//TODO Initialize watchdog
 	InitHardware();
@@ -363,16 +414,27 @@ int main()
 	//Display startup message
 	if( g_Config.fStartupMessageOn )
 	{
-		ledPuts_EE( (uint8_t*)&ee_Message );
+		ledPuts_EE( (uint8_t*)&ee_Message, MESSAGE_SIZE );
 	}
 
-	//initialize temperature conversion
-	StartTempConversion();
+	//find sensors, start temperature conversion
+	TempInit();
+	UpdateTemperature();
 
 	//check state of button line at power up
 	if( bit_is_clear(BUTTON_PORT, BUTTON_PIN) )
 	{
 		SelfTest();
+
+#ifdef GEAR_CAPTURE
+		//button held during the whole self test starts capture
+		if( bit_is_clear(BUTTON_PORT, BUTTON_PIN) )
+		{
+			FlashCharNeg('R',3);
+			CaptureStart();
+			loop_until_bit_is_set(BUTTON_PORT, BUTTON_PIN);
+		}
+#endif
 	}
 
 	while(1)
@@ -388,6 +450,12 @@ int main()
 		}
 		else if( BUTTON_SHORT == key )
 		{
+#ifdef GEAR_CAPTURE
+			//rider marks misread gear
+			if( CaptureRunning() )
+				CaptureTrigger();
+			else
+#endif
 			DisplayTemperature();
 		}
 		else if (BUTTON_LONG == key)
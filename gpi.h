@@ -23,14 +23,18 @@
 #ifndef GPI_H_
 #define GPI_H_
 
-/**
- * Default delay for scrolling
- */
-#define DELAY_DEFAULT 20
+#include "adc.h"
 
 /**
- * Scroll delay
+ * Number of system ticks per second.
+ *
+ * One tick is one timer0 overflow (8 bit timer, no prescaler), see \ref g_Ticks.
+ * Timer0 is stopped during conversions in \ref ADC_ACQUISITION_SLEEP mode.
  */
-#define SCROLL_DELAY _delay_ms(DELAY_DEFAULT);
+#if ADC_ACQUISITION == ADC_ACQUISITION_SLEEP
+#define TICKS_PER_SECOND ( ADC_FRAME_TICKS*1000000UL/ADC_FRAME_US )
+#else
+#define TICKS_PER_SECOND (F_CPU/256)
+#endif
 
 #endif /* GPI_H_ */
@@ -6,35 +6,47 @@
 C_SRCS += \
 ../adc.c \
 ../button.c \
+../capture.c \
 ../config.c \
 ../crc8.c \
 ../display.c \
 ../gpi.c \
 ../menu.c \
+../onewire.c \
+../stats.c \
 ../symbols8x8.c \
-../temp.c 
+../temp.c \
+../text.c 
 
 OBJS += \
 ./adc.o \
 ./button.o \
+./capture.o \
 ./config.o \
 ./crc8.o \
 ./display.o \
 ./gpi.o \
 ./menu.o \
+./onewire.o \
+./stats.o \
 ./symbols8x8.o \
-./temp.o 
+./temp.o \
+./text.o 
 
 C_DEPS += \
 ./adc.d \
 ./button.d \
+./capture.d \
 ./config.d \
 ./crc8.d \
 ./display.d \
 ./gpi.d \
 ./menu.d \
+./onewire.d \
+./stats.d \
 ./symbols8x8.d \
-./temp.d 
+./temp.d \
+./text.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
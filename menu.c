@@ -25,11 +25,15 @@
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
 #include <string.h>
+#include <util/atomic.h>
 #include "gpi.h"
 #include "config.h"
 #include "display.h"
 #include "button.h"
 #include "adc.h"
+#include "text.h"
+#include "capture.h"
+#include "stats.h"
 
 /**
  * \defgroup menu Menu
@@ -39,14 +43,16 @@
 
 
 /**
- * Displays text from \a g_TextBuffer and checks button state.
+ * Displays text from the stream and checks button state.
+ *
+ * @param pText Text to display.
  *
  * @retval BUTTON_SHORT Button pressed short
  * @retval BUTTON_LONG Button pressed long
  * @retval BUTTON_NONE Timeout
  *
  */
-uint8_t ShowText()
+uint8_t ShowText( TEXTSTREAM* pText )
 {
 	int offset = 0;
 	uint8_t key;
@@ -57,7 +63,7 @@ uint8_t ShowText()
 	{
 		do
 		{
-			ScrollLeft(g_TextBuffer, g_TextBufferLen, &offset );
+			ScrollLeftText( pText, &offset );
 
 			key = ButtonCheck();
 			if( key == BUTTON_SHORT || key == BUTTON_LONG )
@@ -65,7 +71,7 @@ uint8_t ShowText()
 				return key;
 			}
 
-			_delay_ms(20);
+			ScrollDelay( &offset );
 
 		} while( offset );
 	}
@@ -82,9 +88,12 @@ uint8_t ShowText()
  */
 uint8_t DisplayText_P( PGM_P szText )
 {
-	g_TextBufferLen = strlen_P( szText );
-	memcpy_P( g_TextBuffer, szText, g_TextBufferLen );
-	return ShowText();
+	TEXTSOURCE src = { TEXT_PGM, szText, 0xFF };
+	TEXTSTREAM text;
+
+	TextOpen( &text, &src, 1 );
+
+	return ShowText( &text );
 }
 
 /**
@@ -98,17 +107,21 @@ uint8_t DisplayText_P( PGM_P szText )
  */
 uint8_t DisplayMenu( PGM_P Name, size_t len1, PGM_P Value, size_t len2 )
 {
-	g_TextBuffer[0] = ' ';
+	static const char Space[] PROGMEM = " ";
+	static const char Arrow[] PROGMEM = { SYMBOL_ARROW, 0 };
 
-	g_TextBufferLen = len1+1;
+	TEXTSOURCE src[] =
+	{
+		{ TEXT_PGM, Space, 1 },
+		{ TEXT_PGM, Name, len1 },
+		{ TEXT_PGM, Arrow, 1 },
+		{ TEXT_PGM, Value, len2 },
+	};
+	TEXTSTREAM text;
 
-	memcpy_P( g_TextBuffer+1, Name, len1 );
-	g_TextBuffer[g_TextBufferLen++] = SYMBOL_ARROW;
+	TextOpen( &text, src, sizeof(src)/sizeof(TEXTSOURCE) );
 
-	memcpy_P( g_TextBuffer+g_TextBufferLen, Value, len2 );
-	g_TextBufferLen += len2;
-	
-	return ShowText();
+	return ShowText( &text );
 }
 
 /**
@@ -119,7 +132,7 @@ uint8_t DisplayMenu( PGM_P Name, size_t len1, PGM_P Value, size_t len2 )
  * @param pMenu Pointer to null terminated string in PROGMEM with menu name and
  * option names divided by '|' character.
  *
- * @param pConfigVar Pointer to variable from \a m_Config.
+ * @param pConfigVar Pointer to variable from \a m_Config or other variable that is not stored in EEPROM.
  *
  * @retval 0 timeout
  * @retval 1 user pressed button for short time (=next menu)
@@ -197,9 +210,10 @@ static inline uint8_t ProcessMenu( uint8_t index, PGM_P pMenu, uint8_t* pConfigV
 	} while( ret == 2 );
 
 
-	if( CurrentValue != *pConfigVar )
+	//store in EEPROM, variables outside of configuration are not stored
+	if( CurrentValue != *pConfigVar &&
+		pConfigVar >= (uint8_t*)&g_Config && pConfigVar < (uint8_t*)(&g_Config+1) )
 	{
-		//store in EEPROM
 		WriteConfig();
 	}
 
@@ -214,7 +228,7 @@ void GearboxConfig()
 {
 	const int WaitTime = 3000; //ms = 3s
 	//TODO Check if level is ok
-	const uint8_t LevelOffset = 10; //in 8-bit ADC readings
+	const uint16_t LevelOffset = GEAR_LEVEL(10); //10 in 8-bit ADC readings
 
 	pCurrentFont = FONTTAB;
 
@@ -238,7 +252,7 @@ void GearboxConfig()
 		_delay_ms( WaitTime );
 
 		//get ADC
-		g_Config.GearLevel[g] = GetADC( GEAR_PIN );
+		g_Config.GearLevel[g] = GearSensor();
 
 		//stop counting gears is two gears got the same voltage levels
 		if( g && g_Config.GearLevel[g] >= g_Config.GearLevel[g-1]-LevelOffset &&
@@ -264,6 +278,99 @@ void GearboxConfig()
 }
 #endif
 
+/**
+ * \name Statistics menu options
+ * Order of options of STATS menu in ConfigMenu().
+ * @{
+ */
+/// Nothing to do
+#define STATS_MENU_HIDE 0
+/// Display statistics
+#define STATS_MENU_SHOW 1
+/// Clear statistics
+#define STATS_MENU_CLEAR 2
+///@}
+
+/**
+ * Displays one line of statistics from \ref g_TextBuffer.
+ *
+ * @retval BUTTON_LONG User wants to quit.
+ */
+static uint8_t ShowStatsLine()
+{
+	TEXTSOURCE src = { TEXT_RAM, g_TextBuffer, TEXTBUFFER_SIZE };
+	TEXTSTREAM text;
+
+	TextOpen( &text, &src, 1 );
+
+	return ShowText( &text );
+}
+
+/**
+ * @brief Displays gearbox usage statistics.
+ *
+ * Time in every gear as hours:minutes, then number of shifts for every bucket
+ * of the duration histogram labelled by its upper limit. Short click shows
+ * the next line, long click quits.
+ */
+static inline void ShowStats()
+{
+	STATS stats;
+	uint8_t count = TopGear();
+	char* p;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		stats = g_Stats;
+	}
+
+	if( BUTTON_LONG == DisplayText_P( PSTR(" TIME IN GEAR") ) )
+		return;
+
+	for( uint8_t g = 0; g <= count; g++ )
+	{
+		//" N 1092:15"
+		uint8_t min = stats.Minutes[g] % 60;
+
+		p = g_TextBuffer;
+		*p++ = ' ';
+		*p++ = g ? '0'+g : 'N';
+		*p++ = ' ';
+		utoa( stats.Minutes[g] / 60, p, 10 );
+		p += strlen( p );
+		*p++ = ':';
+		*p++ = '0' + min / 10;
+		*p++ = '0' + min % 10;
+		*p = 0;
+
+		if( BUTTON_LONG == ShowStatsLine() )
+			return;
+	}
+
+	if( BUTTON_LONG == DisplayText_P( PSTR(" SHIFT TIME") ) )
+		return;
+
+	for( uint8_t b = 0; b < STATS_SHIFT_BUCKETS; b++ )
+	{
+		//"262MS 65535", the last bucket " LONG 65535"
+		p = g_TextBuffer;
+		if( b < STATS_SHIFT_BUCKETS-1 )
+		{
+			utoa( ((uint32_t)1000 << (STATS_SHIFT_BITS+b)) / TICKS_PER_SECOND, p, 10 );
+			strcat_P( p, PSTR("MS ") );
+		}
+		else
+		{
+			strcpy_P( p, PSTR(" LONG ") );
+		}
+		p += strlen( p );
+		utoa( stats.Shifts[b], p, 10 );
+
+		if( BUTTON_LONG == ShowStatsLine() )
+			return;
+	}
+}
+
 /**
  * @brief Displays configuration menu.
  */
@@ -275,6 +382,11 @@ void ConfigMenu()
 		uint8_t* pConfigVar;
 	} Menu;
 
+#ifdef GEAR_CAPTURE
+	uint8_t capture = CaptureRunning();
+#endif
+	uint8_t stats = STATS_MENU_HIDE;
+
 	Menu MenuTree[] =
 	{
 			//Keep menu names short for easy reading
@@ -286,6 +398,11 @@ void ConfigMenu()
 			{PSTR("AUTO BRIGHTNESS|ON|OFF"), &g_Config.fAutoBrightnessOff },
 			{PSTR("MIN BRIGHTNESS|0|1|2|3"), &g_Config.MinBrightness},
 			{PSTR("STARTUP MSG|OFF|ON"), &g_Config.fStartupMessageOn},
+			{PSTR("SCROLL SPEED|NORMAL|SLOW|FAST"), &g_Config.ScrollingSpeed},
+#ifdef GEAR_CAPTURE
+			{PSTR("CAPTURE|OFF|ON"), &capture},
+#endif
+			{PSTR("STATS|HIDE|SHOW|CLEAR"), &stats},
 	};
 
 
@@ -304,6 +421,19 @@ void ConfigMenu()
 			i=0;
 	}
 
+#ifdef GEAR_CAPTURE
+	//capture is not stored, it runs until trigger or power off
+	if( capture && !CaptureRunning() )
+		CaptureStart();
+	else if( !capture )
+		CaptureStop();
+#endif
+
+	if( STATS_MENU_SHOW == stats )
+		ShowStats();
+	else if( STATS_MENU_CLEAR == stats )
+		StatsClear();
+
 	return;
 }
 
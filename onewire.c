@@ -0,0 +1,324 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief 1-Wire bus master driven by timer2
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/delay.h>
+#include "onewire.h"
+
+/**
+ * \defgroup onewire 1-Wire bus
+ * \brief Background 1-Wire master.
+ *
+ * OwTransfer() starts reset, write and read of whole bytes and returns at
+ * once. Timer2 in CTC mode schedules every step of the transfer by compare
+ * match interrupt; interrupt routine only drives the line at the edges of a slot:
+ * ca 3us for reset, write slots and the end of write 0 slot, ca 13us for read
+ * slot (falling edge to sample point). Between the edges display and ADC
+ * interrupts run as usual, the main loop checks OwStatus(). OwBits() continues
+ * the transfer by single bits, as needed by the ROM search.
+ *
+ * Other interrupts may delay the end of write 0 slot, the low pulse is
+ * stretched but remains far below reset. Timer2 must not stop during transfer,
+ * see AdcSleepConvert().
+ *
+ * Based on Peter Dannegger code.
+ * @{
+ */
+
+/// Timer2 compare value of interval in microseconds, prescaler 8
+#define OW_TICKS(us) ( (uint8_t)( (us) * (F_CPU/8/1000) / 1000 - 1 ) )
+
+/**
+ * \name Transfer states
+ * Step executed by the next compare match interrupt.
+ * @{
+ */
+/// The second half of reset pulse
+#define OW_STATE_RESET 0
+/// Release the line after reset pulse
+#define OW_STATE_RELEASE 1
+/// Sample presence pulse
+#define OW_STATE_PRESENCE 2
+/// Wait for the end of presence pulse
+#define OW_STATE_WAIT 3
+/// Check that the line is high, start the first slot
+#define OW_STATE_CHECK 4
+/// Start slot
+#define OW_STATE_SLOT 5
+/// End of write 0 slot
+#define OW_STATE_ZERO 6
+/// Transfer completed after the last slot
+#define OW_STATE_DONE 7
+///@}
+
+/// Next step of the transfer, e.g. \ref OW_STATE_SLOT
+static uint8_t OwState;
+/// Byte being transferred
+static uint8_t* OwData;
+/// Number of bits to write, including the current one
+static uint8_t OwWriteLeft;
+/// Number of bits to transfer, including the current one
+static uint8_t OwLeft;
+/// Bit of \a OwData being transferred
+static uint8_t OwMask;
+/// Result of the transfer, \ref OW_BUSY while running
+static volatile uint8_t OwResult = OW_OK;
+
+/**
+ * \brief Starts transfer of bits.
+ *
+ * \param pData Bits to write followed by space for read bits, LSB first.
+ * \param nWrite Number of bits to write.
+ * \param nRead Number of bits to read.
+ * \param reset Non zero to start by reset pulse.
+ * \return See OwTransfer().
+ */
+static uint8_t OwStart( uint8_t* pData, uint8_t nWrite, uint8_t nRead, uint8_t reset )
+{
+	if( OW_BUSY == OwResult )
+		return OW_BUSY;
+
+	OwData = pData;
+	OwWriteLeft = nWrite;
+	OwLeft = nWrite + nRead;
+	OwMask = 1;
+	OwResult = OW_BUSY;
+
+	//CTC mode, 1us per count
+	TCCR2A = _BV( WGM21 );
+	TCNT2 = 0;
+
+	if( reset )
+	{
+		OW_OUT_LOW();
+		OW_DIR_OUT();
+
+		OCR2A = OW_TICKS( OW_RESET_US/2 );
+		OwState = OW_STATE_RESET;
+	}
+	else
+	{
+		OCR2A = OW_TICKS( OW_RECOVERY_US );
+		OwState = OwLeft ? OW_STATE_SLOT : OW_STATE_DONE;
+	}
+
+	TIFR2 = _BV( OCF2A );
+	TIMSK2 = _BV( OCIE2A );
+	TCCR2B = _BV( CS21 );
+
+	return OW_OK;
+}
+
+/**
+ * \brief Starts 1-Wire transfer in background.
+ *
+ * Bus is reset, \a nWrite bytes from \a pData are written and \a nRead bytes
+ * are read into \a pData after the written ones. Buffer must stay valid until
+ * OwStatus() returns other value than \ref OW_BUSY.
+ *
+ * \param pData Bytes to write followed by space for read bytes.
+ * \param nWrite Number of bytes to write.
+ * \param nRead Number of bytes to read, \a nWrite + \a nRead is at most 31.
+ * \retval OW_BUSY The previous transfer is still running, nothing started.
+ * \retval OW_OK Transfer started.
+ */
+uint8_t OwTransfer( uint8_t* pData, uint8_t nWrite, uint8_t nRead )
+{
+	return OwStart( pData, nWrite*8, nRead*8, 1 );
+}
+
+/**
+ * \brief Starts transfer of single bits without reset.
+ *
+ * Continues the previous transfer, e.g. the ROM search reads two bits and
+ * writes one for every bit of ROM code. Bits are stored LSB first, see
+ * OwTransfer().
+ *
+ * \param pData Bits to write followed by space for read bits.
+ * \param nWrite Number of bits to write.
+ * \param nRead Number of bits to read.
+ * \return See OwTransfer().
+ */
+uint8_t OwBits( uint8_t* pData, uint8_t nWrite, uint8_t nRead )
+{
+	return OwStart( pData, nWrite, nRead, 0 );
+}
+
+/**
+ * \brief Returns state of the last transfer.
+ *
+ * \return \ref OW_BUSY while running, \ref OW_OK or error code when completed.
+ */
+uint8_t OwStatus()
+{
+	return OwResult;
+}
+
+/**
+ * \brief Waits for the end of the transfer.
+ *
+ * CPU sleeps between interrupts.
+ *
+ * \return Transfer status, see OwStatus().
+ */
+uint8_t OwWait()
+{
+	while( OW_BUSY == OwResult )
+		sleep_mode();
+
+	return OwResult;
+}
+
+/**
+ * Releases the line, pull-up resistor pulls it high.
+ */
+static inline void OwRelease()
+{
+	OW_DIR_IN();
+	OW_OUT_HIGH(); //internal pull-up
+}
+
+/**
+ * Stops timer and sets transfer result.
+ */
+static inline void OwFinish( uint8_t result )
+{
+	TCCR2B = 0;
+	TIMSK2 = 0;
+	OwResult = result;
+}
+
+/**
+ * \brief Starts one time slot.
+ *
+ * Write 1 and read slots are completed here, write 0 slot ends in the next step.
+ */
+static inline void OwSlot()
+{
+	uint8_t bit = OwWriteLeft ? *OwData & OwMask : 1;
+
+	OW_OUT_LOW();
+	OW_DIR_OUT();
+	_delay_us( OW_LOW_US );
+
+	if( bit )
+	{
+		OwRelease();
+
+		if( !OwWriteLeft )
+		{
+			// "Output data from the DS18B20 is valid for 15usec after the falling
+			// edge that initiated the read time slot."
+			_delay_us( OW_SAMPLE_US - OW_LOW_US );
+
+			if( OW_GET_IN() )
+				*OwData |= OwMask;
+			else
+				*OwData &= ~OwMask;
+		}
+	}
+
+	//the next bit
+	OwLeft--;
+	if( OwWriteLeft )
+		OwWriteLeft--;
+
+	OwMask <<= 1;
+	if( !OwMask )
+	{
+		OwMask = 1;
+		OwData++;
+	}
+
+	if( !bit )
+	{
+		OCR2A = OW_TICKS( OW_ZERO_US - OW_LOW_US );
+		OwState = OW_STATE_ZERO;
+	}
+	else
+	{
+		OCR2A = OW_TICKS( OW_ZERO_US + OW_RECOVERY_US );
+		OwState = OwLeft ? OW_STATE_SLOT : OW_STATE_DONE;
+	}
+}
+
+/**
+ * \brief Timer2 compare match interrupt, executes the next step of the transfer.
+ */
+ISR(TIMER2_COMPA_vect)
+{
+	switch( OwState )
+	{
+	case OW_STATE_RESET:
+		OwState = OW_STATE_RELEASE;
+		break;
+
+	case OW_STATE_RELEASE:
+		OwRelease();
+		OCR2A = OW_TICKS( OW_PRESENCE_US );
+		OwState = OW_STATE_PRESENCE;
+		break;
+
+	case OW_STATE_PRESENCE:
+		if( OW_GET_IN() )
+		{
+			OwFinish( OW_ERROR_PRESENCE ); //nobody pulled to low, still high
+			break;
+		}
+		OCR2A = OW_TICKS( (OW_RESET_US - OW_PRESENCE_US)/2 );
+		OwState = OW_STATE_WAIT;
+		break;
+
+	case OW_STATE_WAIT:
+		OwState = OW_STATE_CHECK;
+		break;
+
+	case OW_STATE_CHECK:
+		// after a delay the clients should release the line
+		// and input-pin gets back to high by pull-up-resistor
+		if( !OW_GET_IN() )
+			OwFinish( OW_ERROR_SHORT );
+		else if( !OwLeft )
+			OwFinish( OW_OK );
+		else
+			OwSlot();
+		break;
+
+	case OW_STATE_SLOT:
+		OwSlot();
+		break;
+
+	case OW_STATE_ZERO:
+		OwRelease();
+		OCR2A = OW_TICKS( OW_RECOVERY_US );
+		OwState = OwLeft ? OW_STATE_SLOT : OW_STATE_DONE;
+		break;
+
+	default:
+		OwFinish( OW_OK );
+		break;
+	}
+}
+
+/** @} */
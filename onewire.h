@@ -0,0 +1,102 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief 1-Wire bus master header
+ * @ingroup onewire
+ */
+
+#ifndef ONEWIRE_H_
+#define ONEWIRE_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+
+/* One wire */
+
+#define OW_PIN  PC5
+#define OW_IN   PINC
+#define OW_OUT  PORTC
+#define OW_DDR  DDRC
+
+/**
+ * \name 1wire low-level routines
+ * @{
+ */
+#define OW_GET_IN()   ( OW_IN & (1<<OW_PIN))
+#define OW_OUT_LOW()  ( OW_OUT &= (~(1 << OW_PIN)) )
+#define OW_OUT_HIGH() ( OW_OUT |= (1 << OW_PIN) )
+#define OW_DIR_IN()   ( OW_DDR &= (~(1 << OW_PIN )) )
+#define OW_DIR_OUT()  ( OW_DDR |= (1 << OW_PIN) )
+///@}
+
+/**
+ * \name 1wire commands
+ * @{
+ */
+#define OW_SEARCH_ROM   0xF0
+#define OW_MATCH_ROM    0x55
+#define OW_SKIP_ROM     0xCC
+#define OW_CONVERT      0x44
+#define OW_READ         0xBE
+#define OW_WRITE        0x4E
+///@}
+
+/**
+ * \name 1wire timing [us]
+ * Timer2 counts microseconds, one interval is at most 256us.
+ * @{
+ */
+/// Reset pulse, generated as two intervals
+#define OW_RESET_US 480
+/// Presence pulse is sampled this time after reset pulse
+#define OW_PRESENCE_US 70
+/// Low pulse that starts read and write 1 slot (T_INT > 1us)
+#define OW_LOW_US 2
+/// Sample point of read slot from the falling edge, data is valid for 15us
+#define OW_SAMPLE_US 12
+/// Low pulse of write 0 slot
+#define OW_ZERO_US 60
+/// Recovery time between slots, may be increased for longer wires
+#define OW_RECOVERY_US 10
+///@}
+
+/**
+ * \name Transfer status
+ * Returned by OwStatus().
+ * @{
+ */
+/// Transfer completed
+#define OW_OK 0
+/// No presence pulse after reset, no sensor
+#define OW_ERROR_PRESENCE 1
+/// Bus stays low after reset, short circuit
+#define OW_ERROR_SHORT 2
+/// Transfer is running
+#define OW_BUSY 3
+///@}
+
+/// Length of ROM code in bytes: family code, 48-bit serial number, CRC
+#define OW_ROM_SIZE 8
+
+uint8_t OwTransfer( uint8_t* pData, uint8_t nWrite, uint8_t nRead );
+uint8_t OwBits( uint8_t* pData, uint8_t nWrite, uint8_t nRead );
+uint8_t OwStatus();
+uint8_t OwWait();
+
+#endif /* ONEWIRE_H_ */
@@ -0,0 +1,74 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief EEPROM access for the host build.
+ *
+ * EEPROM variables are ordinary variables in \c eeprom section, see
+ * SimWriteEeprom(). Every written byte is counted in \ref g_SimEepromWrites.
+ */
+
+#ifndef SIM_AVR_EEPROM_H_
+#define SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "sim.h"
+
+#define EEMEM __attribute__((section("eeprom")))
+
+static inline uint8_t eeprom_read_byte( const uint8_t* p )
+{
+	return *p;
+}
+
+static inline uint16_t eeprom_read_word( const uint16_t* p )
+{
+	return *p;
+}
+
+static inline void eeprom_read_block( void* dst, const void* src, size_t n )
+{
+	memcpy( dst, src, n );
+}
+
+static inline void eeprom_write_byte( uint8_t* p, uint8_t value )
+{
+	*p = value;
+	g_SimEepromWrites++;
+}
+
+static inline void eeprom_update_byte( uint8_t* p, uint8_t value )
+{
+	if( *p != value )
+		eeprom_write_byte( p, value );
+}
+
+static inline void eeprom_write_block( const void* src, void* dst, size_t n )
+{
+	memcpy( dst, src, n );
+	g_SimEepromWrites += n;
+}
+
+static inline void eeprom_update_block( const void* src, void* dst, size_t n )
+{
+	for( size_t i = 0; i < n; i++ )
+		eeprom_update_byte( (uint8_t*)dst + i, ((const uint8_t*)src)[i] );
+}
+
+#endif /* SIM_AVR_EEPROM_H_ */
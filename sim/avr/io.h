@@ -0,0 +1,137 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Simulated ATmega88 I/O registers for the host build.
+ *
+ * Registers are plain variables. Peripherals are emulated by sim.c.
+ */
+
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+#include "sim.h"
+
+/**
+ * \name I/O registers
+ * @{
+ */
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t ICR1;
+#define TCNT1 SimTimer1()
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2, TIFR2;
+extern volatile uint8_t PCICR, PCIFR, PCMSK1;
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, ADCL, ADCH, DIDR0;
+#define ADC ( ADCL | ((uint16_t)ADCH << 8) )
+extern volatile uint8_t SMCR;
+///@}
+
+/**
+ * \name Register bits
+ * @{
+ */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define TOIE0 0
+#define OCIE0A 1
+#define TOV0 0
+#define OCF0A 1
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define ICES1 6
+#define ICNC1 7
+#define TOIE1 0
+#define ICIE1 5
+#define TOV1 0
+#define ICF1 5
+
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+#define OCF2A 1
+
+#define PCIE1 1
+#define PCIF1 1
+#define PCINT8 0
+
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
+
+#define SM2 3
+#define SM1 2
+#define SM0 1
+#define SE 0
+///@}
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) do { SimIdle(); } while( bit_is_clear(sfr, bit) )
+#define loop_until_bit_is_clear(sfr, bit) do { SimIdle(); } while( bit_is_set(sfr, bit) )
+
+#endif /* SIM_AVR_IO_H_ */
@@ -0,0 +1,346 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Simulated DS18B20 sensors on 1-Wire bus.
+ *
+ * Sensors watch the 1-Wire pin of port C. Every time the simulator runs, the
+ * state of the pin driven by the firmware is compared with the previous one.
+ * Falling edge starts a time slot, the length of the low pulse tells reset
+ * (480us and more), write 0 (15us and more) or write 1/read slot. Sensor
+ * answers by pulling the line low: presence pulse 30-150us after reset,
+ * 0 bit 30us from the falling edge. \c PINC shows wired AND of all drivers.
+ *
+ * Supported commands: SEARCH ROM, MATCH ROM, SKIP ROM, CONVERT T (750ms for
+ * 12 bits, half for every bit less, read slots return 0 while converting),
+ * READ SCRATCHPAD, WRITE SCRATCHPAD. Sensor \a i has ROM code 28 i+1 ... CRC,
+ * see PowerUp().
+ */
+
+#include <string.h>
+#include <avr/io.h>
+#include "sim.h"
+#include "ds18b20.h"
+#include "../onewire.h"
+
+/**
+ * \addtogroup sim
+ * @{
+ */
+
+/// Converts microseconds to CPU cycles
+#define US(us) ( (uint64_t)(us) * (F_CPU/1000000) )
+
+/**
+ * \name Sensor states
+ * @{
+ */
+/// Waiting for reset
+#define DS_IDLE 0
+/// Receiving ROM command
+#define DS_ROM 1
+/// Receiving function command
+#define DS_FUNCTION 2
+/// Sending \a Data
+#define DS_SEND 3
+/// Converting temperature
+#define DS_CONVERT 4
+/// Receiving ROM code of MATCH ROM
+#define DS_MATCH 5
+/// Taking part in SEARCH ROM
+#define DS_SEARCH 6
+/// Receiving TH, TL and configuration register
+#define DS_WRITE 7
+///@}
+
+/**
+ * One simulated sensor.
+ */
+typedef struct
+{
+	uint8_t State; ///< e.g. \ref DS_ROM
+	uint8_t Data[9]; ///< Received command or data to send, LSB first
+	uint8_t Bits; ///< Number of bits received or sent, time slots of SEARCH ROM
+	uint8_t Length; ///< Number of bits to receive or send
+	uint8_t Rom[8]; ///< ROM code
+	uint8_t Scratchpad[9]; ///< Scratchpad memory
+	uint64_t ConvertDone; ///< Time the conversion ends
+	uint64_t LowFrom; ///< Sensor pulls the line low from this time...
+	uint64_t LowUntil; ///< ...until this time
+} SIMDS18B20;
+
+/// Number of sensors on the bus.
+uint8_t g_SimOwDevices = 1;
+
+/// Temperature of every sensor in Celsius*16, raw 12-bit reading.
+int16_t g_SimOwTemperature[ SIM_OW_DEVICES ] = { 25*16, 90*16, 110*16, -5*16 };
+
+/// Number of reset pulses.
+unsigned long g_SimOwResets;
+
+/// Number of read and write time slots.
+unsigned long g_SimOwSlots;
+
+static SIMDS18B20 Devices[ SIM_OW_DEVICES ];
+static uint8_t MasterLow;
+static uint64_t MasterFall;
+static uint8_t Initialized;
+
+/**
+ * Dallas/Maxim CRC-8, reference for the firmware.
+ */
+static uint8_t Crc8( const uint8_t* p, uint8_t len )
+{
+	uint8_t crc = 0;
+
+	while( len-- )
+	{
+		uint8_t b = *p++;
+
+		for( uint8_t i = 0; i < 8; i++ )
+		{
+			crc = ((crc ^ b) & 1) ? (crc >> 1) ^ 0x8C : crc >> 1;
+			b >>= 1;
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * Power-up state, temperature register reads 85C.
+ */
+static void PowerUp( uint8_t i, SIMDS18B20* d )
+{
+	static const uint8_t Init[8] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+
+	memset( d, 0, sizeof(*d) );
+	memcpy( d->Scratchpad, Init, 8 );
+	d->Scratchpad[8] = Crc8( d->Scratchpad, 8 );
+
+	//family code, serial number differs in bits searched first
+	d->Rom[0] = 0x28;
+	d->Rom[1] = i + 1;
+	d->Rom[2] = 0xA5;
+	d->Rom[6] = 0x80 >> i;
+	d->Rom[7] = Crc8( d->Rom, 7 );
+}
+
+/**
+ * Starts receiving \a len bytes.
+ */
+static void Receive( SIMDS18B20* d, uint8_t state, uint8_t len )
+{
+	memset( d->Data, 0, sizeof(d->Data) );
+	d->Bits = 0;
+	d->Length = len * 8;
+	d->State = state;
+}
+
+/**
+ * Starts sending \a len bytes.
+ */
+static void Send( SIMDS18B20* d, const uint8_t* p, uint8_t len )
+{
+	memcpy( d->Data, p, len );
+	d->Bits = 0;
+	d->Length = len * 8;
+	d->State = DS_SEND;
+}
+
+/**
+ * Executes received command byte or ROM code.
+ */
+static void Command( uint8_t i, SIMDS18B20* d )
+{
+	uint8_t cmd = d->Data[0];
+
+	if( DS_WRITE == d->State )
+	{
+		//only resolution bits of configuration register are writable
+		d->Scratchpad[2] = d->Data[0];
+		d->Scratchpad[3] = d->Data[1];
+		d->Scratchpad[4] = (d->Data[2] & 0x60) | 0x1F;
+		d->Scratchpad[8] = Crc8( d->Scratchpad, 8 );
+		d->State = DS_IDLE;
+	}
+	else if( DS_MATCH == d->State )
+	{
+		if( memcmp( d->Data, d->Rom, 8 ) )
+			d->State = DS_IDLE;
+		else
+			Receive( d, DS_FUNCTION, 1 );
+	}
+	else if( DS_ROM == d->State )
+	{
+		if( OW_SKIP_ROM == cmd )
+			Receive( d, DS_FUNCTION, 1 );
+		else if( OW_MATCH_ROM == cmd )
+			Receive( d, DS_MATCH, 8 );
+		else if( OW_SEARCH_ROM == cmd )
+			Receive( d, DS_SEARCH, 0 );
+		else
+			d->State = DS_IDLE;
+	}
+	else if( OW_CONVERT == cmd )
+	{
+		//bits below resolution are undefined
+		uint8_t shift = 3 - (d->Scratchpad[4] >> 5 & 3);
+		int16_t t = g_SimOwTemperature[i] | ((1 << shift) - 1);
+
+		d->Scratchpad[0] = t;
+		d->Scratchpad[1] = t >> 8;
+		d->Scratchpad[8] = Crc8( d->Scratchpad, 8 );
+		d->ConvertDone = g_SimCycles + (US(750000) >> shift);
+		d->State = DS_CONVERT;
+	}
+	else if( OW_WRITE == cmd )
+	{
+		Receive( d, DS_WRITE, 3 );
+	}
+	else if( OW_READ == cmd )
+	{
+		Send( d, d->Scratchpad, 9 );
+	}
+	else
+	{
+		d->State = DS_IDLE;
+	}
+}
+
+/**
+ * Falling edge of the master, sensor pulls the line for 0 bit.
+ */
+static void SlotStart( SIMDS18B20* d )
+{
+	uint8_t bit = 1;
+
+	if( DS_SEND == d->State && d->Bits < d->Length )
+	{
+		bit = d->Data[ d->Bits >> 3 ] >> (d->Bits & 7) & 1;
+		d->Bits++;
+	}
+	else if( DS_CONVERT == d->State )
+	{
+		bit = g_SimCycles >= d->ConvertDone;
+	}
+	else if( DS_SEARCH == d->State && d->Bits % 3 < 2 )
+	{
+		//ROM bit, then its complement
+		uint8_t n = d->Bits / 3;
+
+		bit = (d->Rom[ n >> 3 ] >> (n & 7) & 1) ^ (d->Bits % 3);
+	}
+
+	if( !bit )
+	{
+		d->LowFrom = g_SimCycles;
+		d->LowUntil = g_SimCycles + US(30);
+	}
+}
+
+/**
+ * Rising edge of the master, \a low is length of the low pulse.
+ */
+static void SlotEnd( uint8_t i, SIMDS18B20* d, uint64_t low )
+{
+	if( low >= US(480) )
+	{
+		//reset, presence pulse
+		d->LowFrom = g_SimCycles + US(30);
+		d->LowUntil = g_SimCycles + US(150);
+		Receive( d, DS_ROM, 1 );
+		return;
+	}
+
+	if( DS_SEARCH == d->State )
+	{
+		//direction written by the master
+		if( d->Bits % 3 == 2 )
+		{
+			uint8_t n = d->Bits / 3;
+
+			if( (low < US(15)) != (d->Rom[ n >> 3 ] >> (n & 7) & 1) )
+				d->State = DS_IDLE;
+		}
+
+		if( ++d->Bits == 64*3 )
+			d->State = DS_IDLE;
+
+		return;
+	}
+
+	if( DS_ROM != d->State && DS_FUNCTION != d->State && DS_MATCH != d->State && DS_WRITE != d->State )
+		return;
+
+	if( low < US(15) )
+		d->Data[ d->Bits >> 3 ] |= 1 << (d->Bits & 7);
+
+	if( ++d->Bits == d->Length )
+		Command( i, d );
+}
+
+/**
+ * \brief Updates sensors and the 1-Wire pin in \c PINC.
+ *
+ * Called by SimRun() whenever time advances.
+ */
+void SimOwUpdate()
+{
+	uint8_t low = (DDRC & _BV(OW_PIN)) && !(PORTC & _BV(OW_PIN));
+
+	if( !Initialized )
+	{
+		for( uint8_t i = 0; i < SIM_OW_DEVICES; i++ )
+			PowerUp( i, &Devices[i] );
+		Initialized = 1;
+	}
+
+	if( low && !MasterLow )
+	{
+		MasterFall = g_SimCycles;
+		g_SimOwSlots++;
+
+		for( uint8_t i = 0; i < g_SimOwDevices; i++ )
+			SlotStart( &Devices[i] );
+	}
+	else if( !low && MasterLow )
+	{
+		if( g_SimCycles - MasterFall >= US(480) )
+		{
+			g_SimOwResets++;
+			g_SimOwSlots--;
+		}
+
+		for( uint8_t i = 0; i < g_SimOwDevices; i++ )
+			SlotEnd( i, &Devices[i], g_SimCycles - MasterFall );
+	}
+
+	MasterLow = low;
+
+	for( uint8_t i = 0; i < g_SimOwDevices && !low; i++ )
+	{
+		if( g_SimCycles >= Devices[i].LowFrom && g_SimCycles < Devices[i].LowUntil )
+			low = 1;
+	}
+
+	if( low != !(PINC & _BV(OW_PIN)) )
+		SimSetPinC( low ? PINC & ~_BV(OW_PIN) : PINC | _BV(OW_PIN) );
+}
+
+/** @} */
@@ -0,0 +1,40 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Simulated DS18B20 sensors on 1-Wire bus.
+ */
+
+#ifndef SIM_DS18B20_H_
+#define SIM_DS18B20_H_
+
+#include <stdint.h>
+
+/**
+ * Maximal number of simulated sensors.
+ */
+#define SIM_OW_DEVICES 4
+
+extern uint8_t g_SimOwDevices;
+extern int16_t g_SimOwTemperature[ SIM_OW_DEVICES ];
+extern unsigned long g_SimOwResets;
+extern unsigned long g_SimOwSlots;
+
+void SimOwUpdate();
+
+#endif /* SIM_DS18B20_H_ */
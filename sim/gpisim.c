@@ -0,0 +1,1034 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Virtual LED matrix frame recorder.
+ *
+ * Runs display functions of the firmware on PC and records every frame
+ * committed by the display interrupt. Frames can be saved as text log
+ * and/or animated GIF. Number of frames and duration of the animation
+ * is printed on standard output.
+ *
+ * \par Usage
+ * \code
+ * gpisim [-a anim] [-r rotation] [-s speed] [-l log.txt] [-g anim.gif] [-c golden.txt] command [args]
+ *
+ * gear FROM TO    gear change animation
+ * text TEXT       menu text, scrolled twice
+ * temp VALUE      temperature in Celsius*10
+ * message         startup message from EEPROM
+ * golden          all glyphs at all rotations, all gear changes in both animation modes
+ * decode INPUT... gear decoder output for synthetic inputs
+ * ratio PULSES... engine and wheel pulse trains for GEAR_DECODER_RATIO, exit status 1 on wrong gear
+ * noise GEAR N    histogram of N gear samples with ADC noise model
+ * rate FROM TO    sampling rate and shift latency, fixed and adaptive sampling
+ * capture FROM TO FILE  gear signal capture of stuck shift, EEPROM saved to FILE
+ * trace SECONDS [SEED]  synthetic gear sensor trace in CSV format
+ * replay TRACE... gear decoder benchmark with recorded or synthetic traces
+ * onewire SECONDS [TEMP...]  temperature measurement with simulated DS18B20
+ * crc N           crc8() check and benchmark, N blocks
+ * \endcode
+ *
+ * \par Gear decoder
+ * Decoder is selected at build time, e.g. <tt>make DECODER=GEAR_DECODER_DL650</tt>.
+ * Every \c INPUT of \c decode command is <tt>GEAR[:NEUTRAL[:PINC]]</tt>, 10-bit
+ * ADC readings of \ref GEAR_PIN and \ref NEUTRAL_PIN and hexadecimal state of
+ * port C. Every input is held for \ref DECODE_TIME and then GetGear() and
+ * PredictGear() results are printed:
+ * \code
+ * ./gpisim decode 390 1023 545
+ * \endcode
+ *
+ * Every \c PULSES of \c ratio command is <tt>ENGINE:WHEEL[=GEAR]</tt>, frequencies in Hz of
+ * square waves on ICP1 and PC0, held for \ref RATIO_TIME. Decoded gear, ratio
+ * and number of display interrupts are printed. If expected \c GEAR is given
+ * and differs from the decoded one, the command fails (<tt>make check</tt>
+ * runs it with default gear levels):
+ * \code
+ * make DECODER=GEAR_DECODER_RATIO
+ * ./gpisim ratio 150:9.5=1 150:27.6=6
+ * \endcode
+ *
+ * \par ADC noise
+ * Command \c noise holds 10-bit reading \c GEAR on \ref GEAR_PIN, enables noise
+ * model of the simulator and prints histogram of gear samples. Compare
+ * acquisition modes:
+ * \code
+ * make && ./gpisim noise 466 2000
+ * make clean && make ACQUISITION=ADC_ACQUISITION_SLEEP && ./gpisim noise 466 2000
+ * make clean && make ACQUISITION=ADC_ACQUISITION_TRIGGER && ./gpisim noise 466 2000
+ * \endcode
+ *
+ * \par Adaptive sampling
+ * Command \c rate holds 10-bit gear reading \c FROM, shifts through unknown band
+ * to \c TO and jumps back to \c FROM directly. Conversion rate of stable and
+ * moving signal, latency of both gear changes and number of GetGear() changes
+ * (transient gears) are printed, first for fixed high rate as baseline, then
+ * for adaptive rate:
+ * \code
+ * make DECODER=GEAR_DECODER_DL650
+ * ./gpisim rate 390 545
+ * \endcode
+ *
+ * \par Gear signal capture
+ * Command \c capture starts capture at gear reading \c FROM, after
+ * \ref CAPTURE_HOLD_TIME leaves the sensor in unknown band for
+ * \ref CAPTURE_STUCK_TIME and settles at \c TO. The main loop is emulated
+ * until CaptureSave() stores the capture, EEPROM is written to \c FILE in
+ * Intel HEX format and can be decoded by \c capdecode.pl:
+ * \code
+ * make DECODER=GEAR_DECODER_DL650
+ * ./gpisim capture 390 545 eeprom.hex
+ * perl ../capdecode.pl eeprom.hex
+ * \endcode
+ *
+ * \par Trace replay
+ * Command \c trace writes synthetic ride with vibration, noise, glitches,
+ * spikes between gears and neutral transitions, see replay.c for the format.
+ * Command \c replay feeds traces to the decoder and prints latency of every
+ * shift, prediction time (negative if the gear was predicted before the new
+ * level settled), missed shifts, false gear changes per hour and host CPU
+ * cycles spent in ADC interrupt. Host cycles only compare decoder and filter
+ * variants, they are not AVR cycles:
+ * \code
+ * make DECODER=GEAR_DECODER_DL650
+ * ./gpisim trace 600 1 > ride1.csv
+ * ./gpisim replay ride1.csv capture.csv
+ * \endcode
+ *
+ * \par 1-Wire
+ * Command \c onewire runs temperature measurement for \c SECONDS with
+ * simulated DS18B20 sensors at \c TEMP (Celsius*10, default 25C), see
+ * ds18b20.c. Sensors are found by ROM search first. Every new reading, number of 1-Wire transfers, bus time,
+ * the longest time with interrupts disabled and lost display interrupts
+ * are printed:
+ * \code
+ * ./gpisim onewire 5 -105
+ * \endcode
+ *
+ * \par CRC8
+ * CRC8 implementation is selected at build time, see \ref CRC8_IMPLEMENTATION.
+ * Command \c crc checks crc8_update() for every CRC and byte value against
+ * bitwise reference and prints host cycles per byte of crc8() with blocks of
+ * scratchpad and configuration size:
+ * \code
+ * make clean && make CRC=CRC8_BITWISE && ./gpisim crc 100000
+ * make clean && make CRC=CRC8_NIBBLE && ./gpisim crc 100000
+ * make clean && make CRC=CRC8_TABLE && ./gpisim crc 100000
+ * \endcode
+ *
+ * \par Golden frames
+ * Frame log of a known good build can be used as reference. Option \c -c compares
+ * recorded frames with the reference log and reports the first difference.
+ * Reference of the default build is \c golden.txt, \c make \c check fails
+ * when frames differ. The log is recorded again only after intended change
+ * of display output:
+ * \code
+ * make check
+ * ./gpisim -l golden.txt golden
+ * \endcode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include "../adc.h"
+#include "../capture.h"
+#include "../config.h"
+#include "../crc8.h"
+#include "../display.h"
+#include "../gpi.h"
+#include "../menu.h"
+#include "../temp.h"
+#include "sim.h"
+#include "ds18b20.h"
+#include "replay.h"
+
+/**
+ * Time the display is left unchanged before and after the command [ms].
+ */
+#define SETTLE_TIME 100
+
+/**
+ * Time every input of \c decode command is held [ms].
+ */
+#define DECODE_TIME 20
+
+/**
+ * Time every input of \c ratio command is held [ms].
+ */
+#define RATIO_TIME 500
+
+/**
+ * Time every gear of \c rate command is held [ms].
+ */
+#define RATE_HOLD_TIME 1000
+
+/**
+ * Time the sensor stays in unknown band during shift in \c rate command [ms].
+ */
+#define RATE_SHIFT_TIME 20
+
+/**
+ * Time every gear of \c capture command is held [ms].
+ */
+#define CAPTURE_HOLD_TIME 300
+
+/**
+ * Time the sensor is stuck in unknown band in \c capture command [ms].
+ */
+#define CAPTURE_STUCK_TIME 100
+
+/**
+ * Period of the main loop in \c onewire command [us].
+ */
+#define ONEWIRE_LOOP_US 1000
+
+/**
+ * Maximal length of histogram bar in \c noise command.
+ */
+#define NOISE_BAR 50
+
+/**
+ * Number of symbols in FONTTAB.
+ */
+#define FONT_SYMBOLS 91
+
+static void Usage()
+{
+	fprintf( stderr,
+		"gpisim [-a anim] [-r rotation] [-s speed] [-l log.txt] [-g anim.gif] [-c golden.txt] command [args]\n"
+		"\n"
+		"  -a  gear animation, 0=up/down 1=left/right 2=none\n"
+		"  -r  display rotation, 0=0deg 1=90deg 2=180deg 3=270deg\n"
+		"  -s  scrolling speed, 0=normal 1=slow 2=fast\n"
+		"  -l  write text frame log\n"
+		"  -g  write animated GIF\n"
+		"  -c  compare frames with text frame log\n"
+		"\n"
+		"Commands:\n"
+		"  gear FROM TO    gear change animation\n"
+		"  text TEXT       menu text, scrolled twice\n"
+		"  temp VALUE      temperature in Celsius*10\n"
+		"  message         startup message from EEPROM\n"
+		"  golden          all glyphs at all rotations, all gear changes in both animation modes\n"
+		"  decode INPUT... gear decoder output, INPUT is GEAR[:NEUTRAL[:PINC]]\n"
+		"  ratio PULSES... engine and wheel pulses, PULSES is ENGINE_HZ:WHEEL_HZ[=GEAR]\n"
+		"  noise GEAR N    histogram of N gear samples with ADC noise model\n"
+		"  rate FROM TO    sampling rate and shift latency, fixed and adaptive sampling\n"
+		"  capture FROM TO FILE  gear signal capture of stuck shift, EEPROM saved to FILE\n"
+		"  trace SECONDS [SEED]  synthetic gear sensor trace in CSV format\n"
+		"  replay TRACE... gear decoder benchmark with recorded or synthetic traces\n"
+		"  onewire SECONDS [TEMP...]  temperature measurement with simulated DS18B20\n"
+		"  crc N           crc8() check and benchmark, N blocks\n" );
+	exit(2);
+}
+
+/**
+ * Hardware setup as in InitHardware().
+ */
+static void InitSimHardware()
+{
+	DDRB = 0xFF;
+	DDRD = 0xFF;
+	DDRC = 0x00;
+
+	InitADC();
+	InitGearDecoder();
+
+	TCCR0A = 0;
+	TCCR0B = _BV(CS00);
+	TIMSK0 = _BV( TOIE0 );
+
+	sei();
+}
+
+/**
+ * Scrolls temperature the same way as DisplayTemperature(), without
+ * reading the sensor.
+ */
+static void ScrollTemperature()
+{
+	int offset = 0;
+
+	FormatTemperature( 0 );
+
+	do
+	{
+		ScrollLeft(g_TextBuffer, g_TextBufferLen, &offset);
+		ScrollDelay( &offset );
+	} while( offset );
+}
+
+/**
+ * Displays every glyph at every rotation, then every gear change
+ * in vertical and horizontal animation mode at every rotation.
+ */
+static void Golden()
+{
+	for( uint8_t r = CONF_ROTATE_0; r <= CONF_ROTATE_270; r++ )
+	{
+		g_Config.DisplayRotation = r;
+
+		for( uint8_t c = 0; c < FONT_SYMBOLS; c++ )
+		{
+			ledPutc( c );
+			_delay_ms( 5 ); //more than one display refresh
+		}
+	}
+
+	for( uint8_t a = CONF_ANIM_UPDOWN; a <= CONF_ANIM_LEFTRIGHT; a++ )
+	{
+		g_Config.GearAnimation = a;
+
+		for( uint8_t r = CONF_ROTATE_0; r <= CONF_ROTATE_270; r++ )
+		{
+			g_Config.DisplayRotation = r;
+
+			for( uint8_t from = 0; from < MAX_GEAR_NUMBER+1; from++ )
+			{
+				for( uint8_t to = 0; to < MAX_GEAR_NUMBER+1; to++ )
+				{
+					if( from == to )
+						continue;
+
+					ledPutc( SYMBOL_GEAR_NUMBER + from );
+					_delay_ms( 5 );
+					Animate( from, to );
+					_delay_ms( 5 );
+				}
+			}
+		}
+	}
+}
+
+/**
+ * \brief Feeds synthetic inputs to the gear decoder.
+ *
+ * \param n Number of inputs.
+ * \param inputs Inputs in GEAR[:NEUTRAL[:PINC]] format.
+ */
+static void Decode( int n, char* inputs[] )
+{
+	printf( "decoder: %d, %d cycles per call\n", GEAR_DECODER, GEAR_DECODER_CYCLES );
+
+	for( int i = 0; i < n; i++ )
+	{
+		unsigned gear = 0, neutral = 0, pins = 0xFF;
+
+		if( sscanf( inputs[i], "%u:%u:%x", &gear, &neutral, &pins ) < 1 )
+			Usage();
+
+		g_SimAnalog[GEAR_PIN] = gear;
+		g_SimAnalog[NEUTRAL_PIN] = neutral;
+
+#if defined(NEUTRAL_INDICATOR) && defined(NEUTRAL_PIN_CHANGE)
+		//digital input on the neutral line
+		pins &= ~_BV(NEUTRAL_PIN);
+		if( neutral >= SIM_INPUT_HIGH )
+			pins |= _BV(NEUTRAL_PIN);
+#endif
+
+		SimSetPinC( pins );
+
+		_delay_ms( DECODE_TIME );
+
+		printf( "%-16s gear %3u predicted %3u\n", inputs[i], GetGear(), PredictGear() );
+	}
+}
+
+/**
+ * \brief Feeds synthetic engine and wheel pulse trains to the gear decoder.
+ *
+ * GetGear() is called every 1ms as the main loop would do. Number of display
+ * interrupts shows if pulse interrupts delay the display.
+ *
+ * \param n Number of inputs.
+ * \param inputs Inputs in ENGINE_HZ:WHEEL_HZ[=GEAR] format.
+ * \return Number of inputs decoded as other than expected gear.
+ */
+static int Ratio( int n, char* inputs[] )
+{
+	int wrong = 0;
+
+	printf( "decoder: %d, %d cycles per call\n", GEAR_DECODER, GEAR_DECODER_CYCLES );
+
+	for( int i = 0; i < n; i++ )
+	{
+		double engine = 0, wheel = 0;
+		int expected = -1;
+
+		if( sscanf( inputs[i], "%lf:%lf=%d", &engine, &wheel, &expected ) < 2 )
+			Usage();
+
+		SimPulse( SIM_PULSE_ICP1, engine > 0 ? F_CPU / engine : 0 );
+		SimPulse( SIM_PULSE_PC0, wheel > 0 ? F_CPU / wheel : 0 );
+
+		uint16_t ticks = GetTicks();
+		uint8_t gear = 0;
+
+		for( int t = 0; t < RATIO_TIME; t++ )
+		{
+			gear = GetGear();
+			_delay_ms( 1 );
+		}
+
+		ticks = GetTicks() - ticks;
+
+		printf( "%-16s gear %3u ratio %3u display ticks %u/%lu%s\n", inputs[i], gear, GearSensor(),
+			ticks, (unsigned long)RATIO_TIME * TICKS_PER_SECOND / 1000,
+			expected >= 0 && expected != gear ? " WRONG" : "" );
+
+		if( expected >= 0 && expected != gear )
+			wrong++;
+	}
+
+	return wrong ? 1 : 0;
+}
+
+/**
+ * \brief Prints histogram of gear sensor samples with ADC noise model.
+ *
+ * One sample is taken every \ref ADC_SAMPLE_US. Measured display tick rate
+ * checks \ref TICKS_PER_SECOND of the acquisition mode.
+ *
+ * \param input 10-bit reading of the gear sensor.
+ * \param n Number of samples.
+ */
+static void Noise( unsigned input, unsigned n )
+{
+	static unsigned count[ 1 << GEAR_BITS ];
+	double sum = 0, sum2 = 0;
+	unsigned lo = (1 << GEAR_BITS) - 1, hi = 0, peak = 0;
+
+	g_SimAnalog[GEAR_PIN] = input;
+	g_SimAdcNoise = 1;
+	_delay_ms( DECODE_TIME );
+
+	uint64_t cycles = g_SimCycles;
+	unsigned long ticks = 0;
+
+	for( unsigned i = 0; i < n; i++ )
+	{
+		uint16_t t = GetTicks();
+
+		_delay_us( ADC_SAMPLE_US );
+		ticks += (uint16_t)(GetTicks() - t);
+
+		unsigned v = GearSensor();
+
+		count[v]++;
+		sum += v;
+		sum2 += (double)v * v;
+
+		if( v < lo )
+			lo = v;
+		if( v > hi )
+			hi = v;
+		if( count[v] > peak )
+			peak = count[v];
+	}
+
+	cycles = g_SimCycles - cycles;
+
+	double mean = sum / n;
+	double dev = sqrt( sum2 / n - mean * mean );
+
+	printf( "acquisition: %d, %d-bit sample every %uus\n", ADC_ACQUISITION, GEAR_BITS, (unsigned)ADC_SAMPLE_US );
+	printf( "display ticks: %.0f/s, TICKS_PER_SECOND %lu\n", ticks * (double)F_CPU / cycles, (unsigned long)TICKS_PER_SECOND );
+	printf( "mean: %.2f (%.2f 10-bit)\n", mean, mean / (1 << GEAR_OVERSAMPLE_BITS) );
+	printf( "std dev: %.2f (%.2f 10-bit)\n", dev, dev / (1 << GEAR_OVERSAMPLE_BITS) );
+
+	for( unsigned v = lo; v <= hi; v++ )
+	{
+		printf( "%5u %6u ", v, count[v] );
+		for( unsigned b = 0; b < (count[v] * NOISE_BAR + peak - 1) / peak; b++ )
+			putchar( '#' );
+		putchar( '\n' );
+	}
+}
+
+#ifdef GEAR_ADAPTIVE_RATE
+/**
+ * Rate command holds the high sampling rate, fixed rate baseline.
+ */
+static uint8_t RateFixed;
+#endif
+
+/**
+ * \brief Waits given time, with \ref RateFixed ends every sampling pause at once.
+ *
+ * AdcFrame() is called as if display frames passed, so the ADC samples at the
+ * high rate as without adaptive rate.
+ *
+ * \param us Time [us].
+ */
+static void RateWait( unsigned long us )
+{
+	uint64_t start = g_SimCycles;
+
+	while( g_SimCycles - start < (uint64_t)us * (F_CPU/1000000) )
+	{
+		_delay_us( 10 );
+
+#ifdef GEAR_ADAPTIVE_RATE
+		if( RateFixed )
+		{
+			cli();
+			for( uint8_t i = 0; i < GEAR_RATE_PAUSE( GEAR_RATE_MIN_HZ ); i++ )
+				AdcFrame();
+			sei();
+		}
+#endif
+	}
+}
+
+/**
+ * \brief Measures time until GetGear() settles.
+ *
+ * GetGear() is polled for \ref RATE_HOLD_TIME, time of its last change is the latency.
+ *
+ * \param pChanges Number of changes, more than one means transient wrong gear.
+ * \return Latency in microseconds.
+ */
+static double GearLatency( unsigned* pChanges )
+{
+	uint64_t start = g_SimCycles;
+	uint64_t last = start;
+	uint8_t gear = GetGear();
+
+	*pChanges = 0;
+
+	while( g_SimCycles - start < (uint64_t)RATE_HOLD_TIME * (F_CPU/1000) )
+	{
+		RateWait( 10 );
+
+		if( GetGear() != gear )
+		{
+			gear = GetGear();
+			last = g_SimCycles;
+			++*pChanges;
+		}
+	}
+
+	return (last - start) * 1e6 / F_CPU;
+}
+
+/**
+ * \brief Returns number of ADC conversions per second in given time.
+ * \param ms Measurement time [ms].
+ */
+static unsigned long ConversionRate( unsigned ms )
+{
+	unsigned long n = g_SimAdcConversions;
+
+	RateWait( ms * 1000UL );
+
+	return (g_SimAdcConversions - n) * 1000 / ms;
+}
+
+/**
+ * \brief One pass of the rate benchmark.
+ *
+ * \param from 10-bit gear reading before and after the shift.
+ * \param to 10-bit gear reading of the next gear.
+ */
+static void RatePass( unsigned from, unsigned to )
+{
+	uint8_t gear;
+	double latency;
+	unsigned changes;
+
+	g_SimAnalog[GEAR_PIN] = from;
+	RateWait( RATE_HOLD_TIME * 1000UL );
+	printf( "  stable: %lu conversions/s\n", ConversionRate( RATE_HOLD_TIME ) );
+
+	gear = GetGear();
+	g_SimAnalog[GEAR_PIN] = 1023;
+	printf( "  moving: %lu conversions/s\n", ConversionRate( RATE_SHIFT_TIME ) );
+	g_SimAnalog[GEAR_PIN] = to;
+	latency = GearLatency( &changes );
+	printf( "  shift %u -> %u latency: %.0fus, %u changes\n", gear, GetGear(), latency, changes );
+
+	gear = GetGear();
+	g_SimAnalog[GEAR_PIN] = from;
+	latency = GearLatency( &changes );
+	printf( "  jump %u -> %u latency: %.0fus, %u changes\n", gear, GetGear(), latency, changes );
+}
+
+/**
+ * \brief Benchmark of adaptive gear sampling rate.
+ *
+ * The same inputs are run with fixed high rate first, as baseline,
+ * then with adaptive rate.
+ *
+ * \param from 10-bit gear reading before and after the shift.
+ * \param to 10-bit gear reading of the next gear.
+ */
+static void Rate( unsigned from, unsigned to )
+{
+	printf( "filter latency: %luus\n", (unsigned long)GEAR_FILTER_LATENCY_US );
+
+#ifdef GEAR_ADAPTIVE_RATE
+	RateFixed = 1;
+	printf( "fixed rate:\n" );
+	RatePass( from, to );
+
+	RateFixed = 0;
+	printf( "adaptive rate: %d-%dHz\n", GEAR_RATE_MIN_HZ, GEAR_RATE_MAX_HZ );
+	RatePass( from, to );
+#else
+	printf( "fixed rate (adaptive rate off):\n" );
+	RatePass( from, to );
+#endif
+}
+
+#ifdef GEAR_CAPTURE
+/**
+ * \brief Captures gear signal of a shift stuck in unknown band.
+ *
+ * CaptureSave() is called every 1ms as the main loop would do. Number of
+ * display interrupts shows if capture delays the display.
+ *
+ * \param from 10-bit gear reading before the shift.
+ * \param to 10-bit gear reading after the shift.
+ * \param szFile EEPROM output file.
+ */
+static void Capture( unsigned from, unsigned to, const char* szFile )
+{
+	unsigned long ticks = 0;
+	unsigned long writes = g_SimEepromWrites;
+	unsigned ms = 0;
+
+	g_SimAnalog[GEAR_PIN] = from;
+	g_SimAdcNoise = 1;
+	_delay_ms( CAPTURE_HOLD_TIME );
+
+	uint64_t cycles = g_SimCycles;
+
+	CaptureStart();
+	printf( "capture: %d blocks, %d-bit sample every %uus, trigger after %lu unknown samples\n",
+		CAPTURE_BLOCKS, GEAR_BITS, (unsigned)ADC_SAMPLE_US, (unsigned long)CAPTURE_UNKNOWN_SAMPLES );
+
+	while( CaptureRunning() && ms < 3*CAPTURE_HOLD_TIME + CAPTURE_STUCK_TIME )
+	{
+		if( ms == CAPTURE_HOLD_TIME )
+			g_SimAnalog[GEAR_PIN] = 1023;
+		else if( ms == CAPTURE_HOLD_TIME + CAPTURE_STUCK_TIME )
+			g_SimAnalog[GEAR_PIN] = to;
+
+		uint16_t t = GetTicks();
+		_delay_ms( 1 );
+		ticks += (uint16_t)(GetTicks() - t);
+		ms++;
+
+		CaptureSave();
+	}
+
+	printf( "stored after %ums, %lu bytes written\n", ms, g_SimEepromWrites - writes );
+	cycles = g_SimCycles - cycles;
+	printf( "display ticks: %lu/%lu\n", ticks, (unsigned long)(cycles * TICKS_PER_SECOND / F_CPU) );
+
+	FILE* f = fopen( szFile, "w" );
+	if( !f )
+	{
+		perror( szFile );
+		exit( 1 );
+	}
+
+	SimWriteEeprom( f );
+	fclose( f );
+}
+#endif
+
+/**
+ * \brief Measures temperature with simulated DS18B20 sensors.
+ *
+ * UpdateTemperature() is called every \ref ONEWIRE_LOOP_US as the main loop
+ * would do, bus is checked at the same time.
+ *
+ * \param seconds Duration of the test.
+ * \param n Number of sensors, 0 for one sensor at 25C.
+ * \param temps Temperature of every sensor in Celsius*10.
+ */
+static void OneWire( unsigned seconds, int n, char* temps[] )
+{
+	const uint64_t loop = (uint64_t)ONEWIRE_LOOP_US * (F_CPU/1000000);
+	unsigned long polls = 0, busy = 0;
+	int16_t prev[ TEMP_SENSORS ];
+
+	if( n > SIM_OW_DEVICES )
+		n = SIM_OW_DEVICES;
+
+	g_SimOwDevices = n ? n : 1;
+	for( int i = 0; i < n; i++ )
+		g_SimOwTemperature[i] = atoi( temps[i] ) * 16 / 10;
+
+	for( int i = 0; i < TEMP_SENSORS; i++ )
+		prev[i] = INVALID_TEMP;
+
+	g_SimMaskedMax = 0;
+	g_SimTimer0Lost = 0;
+
+	uint64_t start = g_SimCycles;
+
+	TempInit();
+	printf( "%8.3fs %d sensors found\n", (double)(g_SimCycles - start) / F_CPU, TempSensors() );
+
+	uint16_t t = GetTicks();
+	unsigned long ticks = 0;
+
+	while( g_SimCycles - start < (uint64_t)seconds * F_CPU )
+	{
+		UpdateTemperature();
+
+		SimRun( loop );
+		ticks += (uint16_t)(GetTicks() - t);
+		t = GetTicks();
+
+		polls++;
+		if( OW_BUSY == OwStatus() )
+			busy++;
+
+		if( memcmp( prev, g_nTemperature, sizeof(prev) ) )
+		{
+			printf( "%8.3fs", (double)(g_SimCycles - start) / F_CPU );
+			for( int i = 0; i < TempSensors(); i++ )
+				printf( " %d", g_nTemperature[i] );
+			printf( "\n" );
+			memcpy( prev, g_nTemperature, sizeof(prev) );
+		}
+	}
+
+	printf( "transfers: %lu, %lu slots\n", g_SimOwResets, g_SimOwSlots );
+	printf( "bus busy: %.1f%%\n", 100.0 * busy / polls );
+	printf( "interrupts disabled: max %.1fus\n", (double)g_SimMaskedMax * 1e6 / F_CPU );
+	printf( "display ticks: %lu/%lu, %lu lost\n", ticks,
+		(unsigned long)((g_SimCycles - start) * TICKS_PER_SECOND / F_CPU), g_SimTimer0Lost );
+}
+
+/**
+ * \brief Checks and benchmarks crc8().
+ *
+ * crc8_update() is compared with bitwise computation for all inputs, then
+ * host cycles per byte of crc8() are measured for blocks of DS18B20
+ * scratchpad and \ref CONFIGURATION size.
+ *
+ * \param n Number of blocks of every size.
+ * \return 0 if CRC is correct.
+ */
+static int Crc( unsigned n )
+{
+	static const char* Names[] = { "bitwise", "nibble", "table" };
+	static const uint16_t Sizes[] = { 8, 9, sizeof(CONFIGURATION) };
+	uint8_t data[ 64 ];
+
+	printf( "implementation: %s\n", Names[ CRC8_IMPLEMENTATION ] );
+
+	for( unsigned c = 0; c < 256; c++ )
+	{
+		for( unsigned b = 0; b < 256; b++ )
+		{
+			uint8_t ref = c ^ b;
+
+			for( uint8_t i = 0; i < 8; i++ )
+				ref = (ref & 1) ? (ref >> 1) ^ 0x8C : ref >> 1;
+
+			if( crc8_update( c, b ) != ref )
+			{
+				printf( "crc8_update( 0x%02X, 0x%02X ) = 0x%02X, expected 0x%02X\n",
+					c, b, crc8_update( c, b ), ref );
+				return 1;
+			}
+		}
+	}
+
+	memcpy( data, "123456789", 9 );
+	if( 0xA1 != crc8( data, 9 ) )
+	{
+		printf( "crc8( \"123456789\" ) = 0x%02X, expected 0xA1\n", crc8( data, 9 ) );
+		return 1;
+	}
+
+	for( unsigned i = 0; i < sizeof(data); i++ )
+		data[i] = rand();
+
+	for( unsigned s = 0; s < sizeof(Sizes)/sizeof(Sizes[0]); s++ )
+	{
+		volatile uint8_t crc = 0;
+		uint64_t t = SimHostCycles();
+
+		for( unsigned i = 0; i < n; i++ )
+		{
+			data[0] = i;
+			crc ^= crc8( data, Sizes[s] );
+		}
+
+		t = SimHostCycles() - t;
+
+		printf( "%2u bytes: %.1f host cycles per byte\n", Sizes[s],
+			n ? (double)t / n / Sizes[s] : 0.0 );
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Compares recorded frames with reference frame log.
+ *
+ * \param szFile Reference log written by SimWriteLog().
+ * \return 0 if frames are the same.
+ */
+static int Compare( const char* szFile )
+{
+	char* pLog;
+	size_t LogSize;
+	FILE* f = open_memstream( &pLog, &LogSize );
+
+	SimWriteLog( f );
+	fclose( f );
+
+	f = fopen( szFile, "r" );
+	if( !f )
+	{
+		perror( szFile );
+		return 1;
+	}
+
+	char line[128];
+	const char* p = pLog;
+	long frame = -1;
+	unsigned n = 0;
+	int ret = 0;
+
+	while( fgets( line, sizeof(line), f ) )
+	{
+		const char* eol = strchr( p, '\n' );
+		size_t len = eol ? (size_t)(eol - p + 1) : strlen( p );
+
+		if( 0 == strncmp( line, "frame ", 6 ) )
+			frame++;
+
+		n++;
+		if( len != strlen( line ) || strncmp( p, line, len ) )
+		{
+			printf( "frame %ld differs (line %u)\n", frame, n );
+			printf( "expected: %s", line );
+			printf( "recorded: %.*s%s", (int)len, p, eol ? "" : "(end)\n" );
+			ret = 1;
+			break;
+		}
+
+		p += len;
+	}
+
+	if( !ret && *p )
+	{
+		printf( "more frames recorded than in %s\n", szFile );
+		ret = 1;
+	}
+
+	fclose( f );
+	free( pLog );
+
+	if( !ret )
+		printf( "frames match %s\n", szFile );
+
+	return ret;
+}
+
+int main( int argc, char* argv[] )
+{
+	const char* szLog = NULL;
+	const char* szGif = NULL;
+	const char* szGolden = NULL;
+	int opt;
+
+	ReadConfig();
+	g_SimAnalog[LIGHT_PIN] = 512;
+
+#if defined(NEUTRAL_INDICATOR) && defined(NEUTRAL_PIN_CHANGE)
+	PINC &= ~_BV(NEUTRAL_PIN); //neutral indicator off
+#endif
+
+	while( (opt = getopt( argc, argv, "+a:r:s:l:g:c:" )) != -1 )
+	{
+		switch( opt )
+		{
+		case 'a':
+			g_Config.GearAnimation = atoi( optarg );
+			break;
+
+		case 'r':
+			g_Config.DisplayRotation = atoi( optarg );
+			break;
+
+		case 's':
+			g_Config.ScrollingSpeed = atoi( optarg );
+			break;
+
+		case 'l':
+			szLog = optarg;
+			break;
+
+		case 'g':
+			szGif = optarg;
+			break;
+
+		case 'c':
+			szGolden = optarg;
+			break;
+
+		default:
+			Usage();
+		}
+	}
+
+	if( optind >= argc )
+		Usage();
+
+	const char* szCmd = argv[optind++];
+
+	InitSimHardware();
+	pCurrentFont = FONTTAB;
+
+	if( 0 == strcmp( szCmd, "gear" ) && argc - optind == 2 )
+	{
+		uint8_t from = atoi( argv[optind] );
+		uint8_t to = atoi( argv[optind+1] );
+
+		ledPutc( SYMBOL_GEAR_NUMBER + from );
+		_delay_ms( SETTLE_TIME );
+		SimResetFrames();
+		Animate( from, to );
+	}
+	else if( 0 == strcmp( szCmd, "text" ) && argc - optind == 1 )
+	{
+		SimResetFrames();
+		DisplayText_P( argv[optind] );
+	}
+	else if( 0 == strcmp( szCmd, "temp" ) && argc - optind == 1 )
+	{
+		g_nTemperature[0] = atoi( argv[optind] );
+		SimResetFrames();
+		ScrollTemperature();
+	}
+	else if( 0 == strcmp( szCmd, "message" ) && argc - optind == 0 )
+	{
+		SimResetFrames();
+		ledPuts_EE( (uint8_t*)&ee_Message, MESSAGE_SIZE );
+	}
+	else if( 0 == strcmp( szCmd, "golden" ) && argc - optind == 0 )
+	{
+		SimResetFrames();
+		Golden();
+	}
+	else if( 0 == strcmp( szCmd, "decode" ) && argc - optind > 0 )
+	{
+		Decode( argc - optind, argv + optind );
+		return 0;
+	}
+	else if( 0 == strcmp( szCmd, "ratio" ) && argc - optind > 0 )
+	{
+		return Ratio( argc - optind, argv + optind );
+	}
+	else if( 0 == strcmp( szCmd, "rate" ) && argc - optind == 2 )
+	{
+		Rate( atoi( argv[optind] ), atoi( argv[optind+1] ) );
+		return 0;
+	}
+#ifdef GEAR_CAPTURE
+	else if( 0 == strcmp( szCmd, "capture" ) && argc - optind == 3 )
+	{
+		Capture( atoi( argv[optind] ), atoi( argv[optind+1] ), argv[optind+2] );
+		return 0;
+	}
+#endif
+#ifdef SIM_REPLAY
+	else if( 0 == strcmp( szCmd, "trace" ) && argc - optind >= 1 && argc - optind <= 2 )
+	{
+		Trace( atoi( argv[optind] ), argc - optind == 2 ? atoi( argv[optind+1] ) : 1 );
+		return 0;
+	}
+	else if( 0 == strcmp( szCmd, "replay" ) && argc - optind > 0 )
+	{
+		return Replay( argc - optind, argv + optind );
+	}
+#endif
+	else if( 0 == strcmp( szCmd, "crc" ) && argc - optind == 1 )
+	{
+		return Crc( atoi( argv[optind] ) );
+	}
+	else if( 0 == strcmp( szCmd, "onewire" ) && argc - optind >= 1 )
+	{
+		OneWire( atoi( argv[optind] ), argc - optind - 1, argv + optind + 1 );
+		return 0;
+	}
+	else if( 0 == strcmp( szCmd, "noise" ) && argc - optind == 2 )
+	{
+		Noise( atoi( argv[optind] ), atoi( argv[optind+1] ) );
+		return 0;
+	}
+	else
+	{
+		Usage();
+	}
+
+	uint64_t start = g_SimFrames[0].Cycles;
+	uint64_t end = g_SimFrames[g_SimFrameCount-1].Cycles;
+
+	_delay_ms( SETTLE_TIME );
+
+	printf( "frames: %zu\n", g_SimFrameCount );
+	printf( "duration: %.3f ms\n", (end - start) * 1000.0 / F_CPU );
+
+	if( szLog )
+	{
+		FILE* f = fopen( szLog, "w" );
+		if( !f )
+		{
+			perror( szLog );
+			return 1;
+		}
+		SimWriteLog( f );
+		fclose( f );
+	}
+
+	if( szGif )
+	{
+		FILE* f = fopen( szGif, "wb" );
+		if( !f )
+		{
+			perror( szGif );
+			return 1;
+		}
+		SimWriteGif( f );
+		fclose( f );
+	}
+
+	if( szGolden )
+		return Compare( szGolden );
+
+	return 0;
+}
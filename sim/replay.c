@@ -0,0 +1,548 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Gear sensor trace generator and replay harness.
+ *
+ * Trace is a CSV file with header line, lines starting with \c # are comments.
+ * Columns are found by name:
+ * - \c time_us time of the row in microseconds, the row is held until the next one
+ * - \c adc 10-bit ADC reading of \ref GEAR_PIN
+ * - \c neutral state of the neutral indicator line, \b 1 high (optional)
+ * - \c gear real gear, \b 0 for neutral (optional, needed for latency)
+ *
+ * Output of \c capdecode.pl can be replayed, it has no \c gear column.
+ *
+ * Replay feeds the trace to the simulated ADC, firmware runs with the
+ * display and the noise model of the simulator. GetGear() and PredictGear()
+ * are polled every \ref REPLAY_POLL_US as the main loop would do, the displayed
+ * gear is passed to StatsGear().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include "../adc.h"
+#include "../config.h"
+#include "../gpi.h"
+#include "../stats.h"
+#include "sim.h"
+#include "replay.h"
+
+#ifdef SIM_REPLAY
+
+/**
+ * \addtogroup sim
+ * @{
+ */
+
+/**
+ * \name Synthetic trace
+ * Rider holds a gear for random time and shifts to the neighbour. Sensor
+ * gives 5V between gears. Engine vibration, noise and short glitches are
+ * added to the level.
+ * @{
+ */
+/// Time between rows [us]
+#define TRACE_STEP_US 200
+/// Minimal time in gear [us]
+#define TRACE_HOLD_MIN 500000
+/// Maximal time in gear [us]
+#define TRACE_HOLD_MAX 8000000
+/// Minimal time between gears [us]
+#define TRACE_SPIKE_MIN 5000
+/// Maximal time between gears [us]
+#define TRACE_SPIKE_MAX 30000
+/// Maximal amplitude of engine vibration, 10-bit LSB
+#define TRACE_VIBRATION 4.0
+/// Standard deviation of sensor noise, 10-bit LSB
+#define TRACE_NOISE 1.0
+/// Average number of glitches per second
+#define TRACE_GLITCH_HZ 2
+/// Maximal glitch offset, 10-bit LSB
+#define TRACE_GLITCH 400
+///@}
+
+/// The highest gear
+#define TRACE_TOP_GEAR TopGear()
+
+#ifdef NEUTRAL_INDICATOR
+/// Gear sensor gives no level in neutral, the neutral line is high
+#define TRACE_LEVEL(g) ( (g) ? (double)g_Config.GearLevel[(g)-1] / (1 << GEAR_OVERSAMPLE_BITS) : 1023 )
+#else
+/// Level of gear, neutral is the first level
+#define TRACE_LEVEL(g) ( (double)g_Config.GearLevel[g] / (1 << GEAR_OVERSAMPLE_BITS) )
+#endif
+
+/**
+ * \name Replay
+ * @{
+ */
+/// Time between GetGear() calls [us]
+#define REPLAY_POLL_US 100
+/// Reading of neutral line at high state if it is sampled by ADC (3.6V)
+#define REPLAY_NEUTRAL_HIGH 737
+/// Conversions of gear sensor per gear sample, including discarded one
+#define REPLAY_GEAR_CONVERSIONS ( GEAR_OVERSAMPLE + (ADC_ACQUISITION == ADC_ACQUISITION_FREE) )
+/// Maximal number of columns
+#define REPLAY_COLUMNS 16
+///@}
+
+/**
+ * Replay results.
+ */
+typedef struct
+{
+	double Time; ///< Trace duration [us]
+	unsigned Shifts; ///< Number of changes of real gear
+	unsigned Detected; ///< Number of detected shifts
+	double LatencySum; ///< Sum of latencies of detected shifts [us]
+	double LatencyMax; ///< The longest latency [us]
+	unsigned False; ///< Number of GetGear() changes to other than real gear, including \a FalsePredicted
+	unsigned FalsePredicted; ///< Number of PredictGear() results other than the gear at the end of the shift
+} REPLAYSTATS;
+
+/**
+ * Replay state of one trace.
+ */
+typedef struct
+{
+	int Truth; ///< Real gear or -1 if not known
+	int From; ///< Real gear before the last change
+	uint64_t Start; ///< Time of the trace start
+	uint64_t ShiftCycles; ///< Time of the last real gear change
+	uint8_t Pending; ///< Last shift is not detected yet
+	uint8_t Gear; ///< The last GetGear() result
+	uint8_t Predicted; ///< The last PredictGear() result
+	uint64_t PredictedCycles; ///< Time of the last PredictGear() change
+	double Lead; ///< Time of matching prediction relative to the shift [us]
+	uint8_t HasLead; ///< Prediction matched the shift
+} REPLAYSTATE;
+
+/**
+ * Returns uniformly distributed random number.
+ */
+static double Uniform( double lo, double hi )
+{
+	return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+/**
+ * Returns gaussian random number with given standard deviation.
+ */
+static double Gauss( double sigma )
+{
+	double sum = 0;
+
+	for( uint8_t i = 0; i < 12; i++ )
+		sum += (double)rand() / RAND_MAX;
+
+	return (sum - 6) * sigma;
+}
+
+/**
+ * Returns gear the rider shifts to from gear \a g.
+ */
+static uint8_t NextGear( uint8_t g )
+{
+	if( 0 == g )
+		return Uniform( 0, 1 ) < 0.8 ? 1 : 2;
+	if( 1 == g )
+		return Uniform( 0, 1 ) < 0.8 ? 2 : 0;
+	if( g >= TRACE_TOP_GEAR )
+		return g - 1;
+
+	return Uniform( 0, 1 ) < 0.55 ? g + 1 : g - 1;
+}
+
+/**
+ * \brief Writes synthetic trace of a ride to standard output.
+ *
+ * Levels are taken from \ref g_Config, the same trace fits the decoder
+ * configuration of the build.
+ *
+ * \param seconds Trace duration.
+ * \param seed Seed of the random generator.
+ */
+void Trace( unsigned seconds, unsigned seed )
+{
+	uint8_t gear = 0, next = 0;
+	double hold = TRACE_HOLD_MIN, spike = 0;
+	double amplitude = 0, freq = 50, glitch = 0, offset = 0;
+
+	srand( seed );
+
+	printf( "# synthetic trace, decoder %d, seed %u\n", GEAR_DECODER, seed );
+	printf( "time_us,adc,neutral,gear\n" );
+
+	for( unsigned long t = 0; t < seconds * 1000000UL; t += TRACE_STEP_US )
+	{
+		if( spike > 0 )
+		{
+			spike -= TRACE_STEP_US;
+			if( spike <= 0 )
+			{
+				gear = next;
+				hold = Uniform( TRACE_HOLD_MIN, TRACE_HOLD_MAX );
+				amplitude = Uniform( 0, TRACE_VIBRATION );
+				freq = Uniform( 30, 150 );
+			}
+		}
+		else if( (hold -= TRACE_STEP_US) <= 0 )
+		{
+			next = NextGear( gear );
+			spike = Uniform( TRACE_SPIKE_MIN, TRACE_SPIKE_MAX );
+		}
+
+		double v = spike > 0 ? 1023 : TRACE_LEVEL( gear );
+
+		v += amplitude * sin( 2 * M_PI * freq * t / 1e6 ) + Gauss( TRACE_NOISE );
+
+		if( glitch > 0 )
+			glitch -= TRACE_STEP_US;
+		else if( Uniform( 0, 1 ) < TRACE_GLITCH_HZ * TRACE_STEP_US / 1e6 )
+		{
+			glitch = Uniform( TRACE_STEP_US, 3*TRACE_STEP_US );
+			offset = Uniform( -TRACE_GLITCH, TRACE_GLITCH );
+		}
+
+		if( glitch > 0 )
+			v += offset;
+
+		int adc = v < 0 ? 0 : (v > 1023 ? 1023 : (int)(v + 0.5));
+
+#ifdef NEUTRAL_INDICATOR
+		uint8_t neutral = 0 == gear && spike <= 0;
+#else
+		uint8_t neutral = 0;
+#endif
+
+		printf( "%lu,%d,%u,%u\n", t, adc, neutral, gear );
+	}
+}
+
+/**
+ * Sets neutral indicator line.
+ */
+static void SetNeutral( uint8_t on )
+{
+#if defined(NEUTRAL_INDICATOR) && defined(NEUTRAL_PIN_CHANGE)
+	SimSetPinC( on ? PINC | _BV(NEUTRAL_PIN) : PINC & ~_BV(NEUTRAL_PIN) );
+#else
+	g_SimAnalog[NEUTRAL_PIN] = on ? REPLAY_NEUTRAL_HIGH : 0;
+#endif
+}
+
+/**
+ * Polls decoder as the main loop would do and updates statistics.
+ */
+static void Poll( REPLAYSTATE* pState, REPLAYSTATS* pStats )
+{
+	uint8_t g = GetGear();
+	uint8_t p = PredictGear();
+
+	StatsGear( GEAR_UNKNOWN != p ? p : g );
+
+	if( p != pState->Predicted )
+	{
+		//prediction is displayed, it is false if the shift ends in other gear
+		if( GEAR_UNKNOWN != pState->Predicted && pState->Truth >= 0 && pState->Predicted != pState->Truth )
+		{
+			pStats->False++;
+			pStats->FalsePredicted++;
+			printf( "%6s %9.3f %2d->%-2d false prediction\n", "", (double)(g_SimCycles - pState->Start) / F_CPU,
+				pState->Truth, pState->Predicted );
+		}
+
+		pState->Predicted = p;
+		pState->PredictedCycles = g_SimCycles;
+
+		if( pState->Pending && !pState->HasLead && p == pState->Truth )
+		{
+			pState->Lead = (double)(g_SimCycles - pState->ShiftCycles) * 1e6 / F_CPU;
+			pState->HasLead = 1;
+		}
+	}
+
+	if( g == pState->Gear )
+		return;
+
+	pState->Gear = g;
+
+	if( pState->Truth < 0 )
+		return;
+
+	if( g != pState->Truth )
+	{
+		pStats->False++;
+		printf( "%6s %9.3f %2d->%-2d false\n", "", (double)(g_SimCycles - pState->Start) / F_CPU, pState->Truth, g );
+		return;
+	}
+
+	if( pState->Pending )
+	{
+		double latency = (double)(g_SimCycles - pState->ShiftCycles) * 1e6 / F_CPU;
+
+		pState->Pending = 0;
+		pStats->Detected++;
+		pStats->LatencySum += latency;
+		if( latency > pStats->LatencyMax )
+			pStats->LatencyMax = latency;
+
+		printf( "%6u %9.3f %2d->%-2d %9.0f ", pStats->Shifts,
+			(double)(pState->ShiftCycles - pState->Start) / F_CPU, pState->From, g, latency );
+
+		if( pState->HasLead )
+			printf( "%12.0f\n", pState->Lead );
+		else
+			printf( "%12s\n", "-" );
+	}
+}
+
+/**
+ * Runs firmware until given time and polls decoder.
+ */
+static void RunUntil( uint64_t end, REPLAYSTATE* pState, REPLAYSTATS* pStats )
+{
+	const uint64_t poll = (uint64_t)REPLAY_POLL_US * (F_CPU/1000000);
+
+	while( g_SimCycles < end )
+	{
+		SimRun( end - g_SimCycles < poll ? end - g_SimCycles : poll );
+		Poll( pState, pStats );
+	}
+}
+
+/**
+ * Splits CSV line in place.
+ * \return Number of fields.
+ */
+static int SplitCsv( char* line, char* fields[] )
+{
+	int n = 0;
+
+	line[ strcspn( line, "\r\n" ) ] = 0;
+
+	for( char* p = strtok( line, "," ); p && n < REPLAY_COLUMNS; p = strtok( NULL, "," ) )
+		fields[n++] = p;
+
+	return n;
+}
+
+/**
+ * Returns index of column \a name, -1 if not found.
+ */
+static int FindColumn( char* fields[], int n, const char* name )
+{
+	for( int i = 0; i < n; i++ )
+	{
+		if( 0 == strcmp( fields[i], name ) )
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * \brief Replays one trace.
+ *
+ * \param szFile Trace file.
+ * \param pStats Results.
+ * \return 0 on success.
+ */
+static int ReplayFile( const char* szFile, REPLAYSTATS* pStats )
+{
+	char line[256];
+	char* fields[ REPLAY_COLUMNS ];
+	int cTime = -1, cAdc = -1, cNeutral = -1, cGear = -1;
+	REPLAYSTATE state;
+	double first = 0;
+	uint64_t start = g_SimCycles;
+	unsigned long rows = 0;
+
+	FILE* f = fopen( szFile, "r" );
+	if( !f )
+	{
+		perror( szFile );
+		return 1;
+	}
+
+	memset( pStats, 0, sizeof(*pStats) );
+	memset( &state, 0, sizeof(state) );
+	StatsClear();
+	state.Truth = -1;
+	state.Start = state.ShiftCycles = start;
+	state.Gear = GetGear();
+	state.Predicted = PredictGear();
+
+	printf( "%s\n", szFile );
+	printf( " shift    time_s  gear latency_us predicted_us\n" );
+
+	while( fgets( line, sizeof(line), f ) )
+	{
+		if( '#' == line[0] )
+			continue;
+
+		int n = SplitCsv( line, fields );
+
+		if( cTime < 0 )
+		{
+			//header
+			cTime = FindColumn( fields, n, "time_us" );
+			cAdc = FindColumn( fields, n, "adc" );
+			cNeutral = FindColumn( fields, n, "neutral" );
+			cGear = FindColumn( fields, n, "gear" );
+
+			if( cTime < 0 || cAdc < 0 )
+			{
+				fprintf( stderr, "%s: time_us and adc columns required\n", szFile );
+				fclose( f );
+				return 1;
+			}
+			continue;
+		}
+
+		if( n <= cTime || n <= cAdc )
+			continue;
+
+		double t = atof( fields[cTime] );
+		if( !rows++ )
+			first = t;
+
+		pStats->Time = t - first;
+		RunUntil( start + (uint64_t)(pStats->Time * (F_CPU/1000000)), &state, pStats );
+
+		g_SimAnalog[GEAR_PIN] = atoi( fields[cAdc] );
+
+		if( cNeutral >= 0 && n > cNeutral )
+			SetNeutral( atoi( fields[cNeutral] ) );
+
+		if( cGear >= 0 && n > cGear )
+		{
+			int truth = atoi( fields[cGear] );
+
+			if( state.Truth >= 0 && truth != state.Truth )
+			{
+				if( state.Pending )
+					printf( "%6u %9.3f %2d->%-2d missed\n", pStats->Shifts,
+						(double)(state.ShiftCycles - start) / F_CPU, state.From, state.Truth );
+
+				//prediction made between gears
+				state.HasLead = 0;
+				if( state.Predicted == truth && state.PredictedCycles > state.ShiftCycles )
+				{
+					state.Lead = -(double)(g_SimCycles - state.PredictedCycles) * 1e6 / F_CPU;
+					state.HasLead = 1;
+				}
+
+				pStats->Shifts++;
+				state.From = state.Truth;
+				state.ShiftCycles = g_SimCycles;
+				state.Pending = 1;
+			}
+
+			state.Truth = truth;
+		}
+	}
+
+	fclose( f );
+
+	return 0;
+}
+
+/**
+ * \brief Replays traces and prints shift latency, false gear changes and cost of ADC interrupt.
+ *
+ * \param n Number of files.
+ * \param files Trace files.
+ * \return 0 on success.
+ */
+int Replay( int n, char* files[] )
+{
+	REPLAYSTATS total = { 0 };
+
+	printf( "decoder: %d, filter: %d, acquisition: %d, %d-bit sample every %uus\n", GEAR_DECODER, GEAR_FILTER,
+		ADC_ACQUISITION, GEAR_BITS, (unsigned)ADC_SAMPLE_US );
+
+	g_SimAdcNoise = 1;
+
+	for( int i = 0; i < n; i++ )
+	{
+		REPLAYSTATS stats;
+
+		memset( g_SimAdcInterrupts, 0, sizeof(g_SimAdcInterrupts) );
+		g_SimAdcIsrCycles = 0;
+
+		if( ReplayFile( files[i], &stats ) )
+			return 1;
+
+		unsigned long interrupts = 0;
+		for( uint8_t ch = 0; ch < 8; ch++ )
+			interrupts += g_SimAdcInterrupts[ch];
+
+		unsigned long samples = g_SimAdcInterrupts[GEAR_PIN] / REPLAY_GEAR_CONVERSIONS;
+
+		printf( "duration: %.1fs, %u shifts, %u missed\n", stats.Time / 1e6, stats.Shifts, stats.Shifts - stats.Detected );
+		if( stats.Detected )
+			printf( "latency: avg %.0fus, max %.0fus\n", stats.LatencySum / stats.Detected, stats.LatencyMax );
+		printf( "false changes: %u, %.1f/h, %u predicted\n", stats.False, stats.Time ? stats.False * 3600e6 / stats.Time : 0,
+			stats.FalsePredicted );
+		if( samples )
+			printf( "host cycles: %.0f per ADC interrupt, %.0f per gear sample (%lu samples)\n",
+				(double)g_SimAdcIsrCycles / interrupts, (double)g_SimAdcIsrCycles / samples, samples );
+
+		printf( "time in gear [min]:" );
+		for( uint8_t g = 0; g <= MAX_GEAR_NUMBER; g++ )
+			printf( " %u", g_Stats.Minutes[g] );
+		printf( "\nshift time [ms]:" );
+		for( uint8_t b = 0; b < STATS_SHIFT_BUCKETS; b++ )
+		{
+			if( b < STATS_SHIFT_BUCKETS-1 )
+				printf( " <%.0f:%u", (1000.0 * (1 << (STATS_SHIFT_BITS+b))) / TICKS_PER_SECOND, g_Stats.Shifts[b] );
+			else
+				printf( " cancelled:%u\n", g_Stats.Shifts[b] );
+		}
+
+		total.Time += stats.Time;
+		total.Shifts += stats.Shifts;
+		total.Detected += stats.Detected;
+		total.LatencySum += stats.LatencySum;
+		total.False += stats.False;
+		total.FalsePredicted += stats.FalsePredicted;
+		if( stats.LatencyMax > total.LatencyMax )
+			total.LatencyMax = stats.LatencyMax;
+	}
+
+	if( n > 1 )
+	{
+		printf( "total\n" );
+		printf( "duration: %.1fs, %u shifts, %u missed\n", total.Time / 1e6, total.Shifts, total.Shifts - total.Detected );
+		if( total.Detected )
+			printf( "latency: avg %.0fus, max %.0fus\n", total.LatencySum / total.Detected, total.LatencyMax );
+		printf( "false changes: %u, %.1f/h, %u predicted\n", total.False, total.Time ? total.False * 3600e6 / total.Time : 0,
+			total.FalsePredicted );
+	}
+
+	return 0;
+}
+
+/** @} */
+
+#endif
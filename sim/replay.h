@@ -0,0 +1,38 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Gear sensor trace generator and replay harness.
+ */
+
+#ifndef SIM_REPLAY_H_
+#define SIM_REPLAY_H_
+
+#include "../adc.h"
+
+#if GEAR_DECODER == GEAR_DECODER_DL650 || GEAR_DECODER == GEAR_DECODER_LADDER
+/**
+ * Decoder reads gear levels from analog sensor, traces can be replayed.
+ */
+#define SIM_REPLAY
+
+void Trace( unsigned seconds, unsigned seed );
+int Replay( int n, char* files[] );
+#endif
+
+#endif /* SIM_REPLAY_H_ */
@@ -0,0 +1,1052 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Host simulator of the GPI hardware.
+ *
+ * Time is counted in CPU cycles. Timer0 overflow, timer1 overflow and input
+ * capture, timer2 compare match A in CTC mode, pin change on port C and ADC
+ * conversions are emulated as events;
+ * interrupt routines of the firmware are called when the event fires and
+ * interrupts are enabled. Pulse generator drives ICP1 and PC0 pins.
+ * ADC Noise Reduction sleep mode starts conversion and stops both timers.
+ * Timer0 compare match A sets OCF0A flag and can auto trigger ADC.
+ * DS18B20 sensors are attached to the 1-Wire pin, see ds18b20.c.
+ *
+ * Optional noise model adds gaussian noise to ADC results, stronger when
+ * I/O clock runs or LED row is lit when conversion starts. It only illustrates
+ * the effect of the acquisition mode, real noise must be measured on the board.
+ *
+ * Every time the display interrupt commits a new picture to \c HardwareBuffer
+ * the frame is recorded.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <avr/io.h>
+#include "sim.h"
+#include "ds18b20.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * \addtogroup sim
+ * @{
+ */
+
+/**
+ * Estimated number of CPU cycles spent in one interrupt routine.
+ */
+#define SIM_ISR_CYCLES 50
+
+/**
+ * \name ADC noise model
+ * Standard deviation in 10-bit LSB.
+ * @{
+ */
+/// Conversion in ADC Noise Reduction sleep, display dark
+#define SIM_ADC_NOISE_QUIET 0.5
+/// Conversion with CPU running, display dark
+#define SIM_ADC_NOISE_DARK 1.0
+/// Conversion with CPU running and LED row lit
+#define SIM_ADC_NOISE_LED 3.0
+///@}
+
+/**
+ * Scale of the LED pixel in GIF image.
+ */
+#define SIM_GIF_SCALE 8
+
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC = 0xFF, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t ICR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2, TIFR2;
+volatile uint8_t PCICR, PCIFR, PCMSK1;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB, ADCL, ADCH, DIDR0;
+volatile uint8_t SMCR;
+
+/// Current time in CPU cycles.
+uint64_t g_SimCycles;
+
+/// Voltage on ADC inputs, 10 bit, 1023 = AVCC.
+uint16_t g_SimAnalog[8];
+
+/// Enables ADC noise model.
+uint8_t g_SimAdcNoise;
+
+/// Number of completed ADC conversions.
+unsigned long g_SimAdcConversions;
+
+/// Number of ADC interrupts for every converted channel.
+unsigned long g_SimAdcInterrupts[8];
+
+/// Host CPU time spent in ADC interrupt routine, see SimHostCycles().
+uint64_t g_SimAdcIsrCycles;
+
+/// Number of bytes written to EEPROM.
+unsigned long g_SimEepromWrites;
+
+/// The longest time with interrupts disabled, including interrupt routines [cycles].
+uint64_t g_SimMaskedMax;
+
+/// Number of timer0 overflows lost because the previous one was not served yet.
+unsigned long g_SimTimer0Lost;
+
+/// Recorded frames.
+SIMFRAME* g_SimFrames;
+
+/// Number of recorded frames.
+size_t g_SimFrameCount;
+
+extern volatile uint8_t HardwareBuffer[8];
+extern volatile uint8_t DisplayBuffer[8];
+
+void PCINT1_vect(void) __attribute__((weak));
+void TIMER2_COMPA_vect(void) __attribute__((weak));
+void TIMER1_CAPT_vect(void) __attribute__((weak));
+void TIMER1_OVF_vect(void) __attribute__((weak));
+void TIMER0_OVF_vect(void) __attribute__((weak));
+void ADC_vect(void) __attribute__((weak));
+
+static uint8_t InterruptsOn; // I flag in SREG
+static uint8_t InIsr;
+static uint64_t MaskedStart; // time interrupts were disabled
+
+static uint64_t Timer0Next;
+static uint64_t Timer0Compare;
+static uint8_t Timer0CompareFlag; // OCF0A, register bit reads 0, writing one clears the flag
+static uint8_t Timer0Pending;
+
+static uint64_t Timer1Start;
+static uint64_t Timer1Next;
+
+static uint8_t Timer2Running;
+static uint64_t Timer2Start; // time the counter was 0
+static uint64_t Timer2Checked; // time compare match was checked last
+static uint8_t Timer2Flag; // OCF2A, register bit reads 0, writing one clears the flag
+
+static uint64_t PulsePeriod[ SIM_PULSES ];
+static uint64_t PulseNext[ SIM_PULSES ];
+static uint8_t PulseLevel[ SIM_PULSES ];
+
+static uint64_t AdcDone;
+static uint8_t AdcRunning;
+static uint8_t AdcPending;
+static double AdcNoise; // standard deviation of noise of the running conversion
+
+static uint8_t ClockIoStopped; // ADC Noise Reduction sleep
+static uint64_t ClockIoStop;
+
+/**
+ * Returns timer0 prescaler or 0 when timer is stopped.
+ */
+static unsigned Timer0Prescaler()
+{
+	static const unsigned Tab[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	return Tab[ TCCR0B & 7 ];
+}
+
+/**
+ * Returns timer1 prescaler or 0 when timer is stopped.
+ */
+static unsigned Timer1Prescaler()
+{
+	static const unsigned Tab[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	return Tab[ TCCR1B & 7 ];
+}
+
+/**
+ * Returns timer2 prescaler or 0 when timer is stopped.
+ */
+static unsigned Timer2Prescaler()
+{
+	static const unsigned Tab[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+	return Tab[ TCCR2B & 7 ];
+}
+
+/**
+ * \brief Returns time of the next timer2 compare match.
+ *
+ * Timer runs in CTC mode, counter is cleared on match. If \c OCR2A was set
+ * below the counter, the counter wraps around first.
+ */
+static uint64_t Timer2Next()
+{
+	uint64_t next = Timer2Start + (OCR2A + 1ULL) * Timer2Prescaler();
+
+	while( next < Timer2Checked )
+		next += 256ULL * Timer2Prescaler();
+
+	return next;
+}
+
+/**
+ * \brief Returns timer1 counter.
+ *
+ * Timer runs in normal mode from the moment the prescaler was set.
+ */
+uint16_t SimTimer1()
+{
+	if( !Timer1Prescaler() )
+		return 0;
+
+	return (g_SimCycles - Timer1Start) / Timer1Prescaler();
+}
+
+/**
+ * \brief Starts square wave on simulated pin.
+ *
+ * \param output Pin, \ref SIM_PULSE_ICP1 or \ref SIM_PULSE_PC0.
+ * \param period Period in CPU cycles, \b 0 stops the generator.
+ */
+void SimPulse( uint8_t output, uint64_t period )
+{
+	PulsePeriod[ output ] = period;
+	PulseNext[ output ] = period ? g_SimCycles + period/2 : 0;
+}
+
+/**
+ * Changes level of the pulse generator output and sets interrupt flags.
+ */
+static void PulseEdge( uint8_t output )
+{
+	uint8_t level = PulseLevel[ output ] = !PulseLevel[ output ];
+
+	PulseNext[ output ] += PulsePeriod[ output ]/2;
+
+	if( SIM_PULSE_ICP1 == output )
+	{
+		if( Timer1Prescaler() && level == !!(TCCR1B & _BV(ICES1)) )
+		{
+			ICR1 = SimTimer1();
+			TIFR1 |= _BV(ICF1);
+		}
+	}
+	else
+	{
+		SimSetPinC( level ? PINC | _BV(PC0) : PINC & ~_BV(PC0) );
+	}
+}
+
+/**
+ * Sets state of port C inputs, change of pin enabled in PCMSK1
+ * raises pin change interrupt flag.
+ */
+void SimSetPinC( uint8_t pins )
+{
+	uint8_t changed = PINC ^ pins;
+
+	PINC = pins;
+
+	if( changed & PCMSK1 )
+		PCIFR |= _BV(PCIF1);
+}
+
+/**
+ * Starts ADC conversion if firmware set ADSC bit.
+ */
+static void AdcCheckStart()
+{
+	static const unsigned Prescaler[8] = { 2, 2, 4, 8, 16, 32, 64, 128 };
+
+	if( AdcRunning || !(ADCSRA & _BV(ADEN)) || !(ADCSRA & _BV(ADSC)) )
+		return;
+
+	AdcRunning = 1;
+	AdcDone = g_SimCycles + 13 * Prescaler[ ADCSRA & 7 ];
+
+	if( PORTB && PORTD )
+		AdcNoise = SIM_ADC_NOISE_LED;
+	else
+		AdcNoise = ClockIoStopped ? SIM_ADC_NOISE_QUIET : SIM_ADC_NOISE_DARK;
+}
+
+/**
+ * Sets OCF0A flag on timer0 compare match, rising flag triggers ADC
+ * if auto trigger source is timer0 compare match A.
+ */
+static void Timer0CompareMatch()
+{
+	if( Timer0CompareFlag )
+		return; //no edge
+
+	Timer0CompareFlag = 1;
+
+	if( (ADCSRA & _BV(ADATE)) && (ADCSRB & 7) == (_BV(ADTS1)|_BV(ADTS0)) && (ADCSRA & _BV(ADEN)) && !AdcRunning )
+	{
+		ADCSRA |= _BV(ADSC);
+		AdcCheckStart();
+	}
+}
+
+/**
+ * Returns gaussian noise with given standard deviation.
+ */
+static double Noise( double sigma )
+{
+	double sum = 0;
+
+	for( uint8_t i = 0; i < 12; i++ )
+		sum += (double)rand() / RAND_MAX;
+
+	return (sum - 6) * sigma;
+}
+
+/**
+ * Starts I/O clock stopped by ADC Noise Reduction sleep, timers
+ * continue from the same state.
+ */
+static void ClockIoStart()
+{
+	uint64_t stopped = g_SimCycles - ClockIoStop;
+
+	ClockIoStopped = 0;
+
+	if( Timer0Next )
+	{
+		Timer0Next += stopped;
+		Timer0Compare += stopped;
+	}
+
+	if( Timer1Next )
+	{
+		Timer1Next += stopped;
+		Timer1Start += stopped;
+	}
+
+	if( Timer2Running )
+	{
+		Timer2Start += stopped;
+		Timer2Checked += stopped;
+	}
+}
+
+/**
+ * Finishes ADC conversion, stores result as hardware does.
+ */
+static void AdcComplete()
+{
+	uint8_t ch = ADMUX & 0x0F;
+	int v = ch < 8 ? g_SimAnalog[ch] : 0;
+
+	if( g_SimAdcNoise )
+		v += (int)(Noise( AdcNoise ) + 1000.5) - 1000;
+
+	if( v < 0 )
+		v = 0;
+	else if( v > 1023 )
+		v = 1023;
+
+	if( ADMUX & _BV(ADLAR) )
+	{
+		ADCH = v >> 2;
+		ADCL = (v & 3) << 6;
+	}
+	else
+	{
+		ADCH = v >> 8;
+		ADCL = v & 0xFF;
+	}
+
+	AdcRunning = 0;
+	g_SimAdcConversions++;
+	ADCSRA &= ~_BV(ADSC);
+	ADCSRA |= _BV(ADIF);
+
+	if( ADCSRA & _BV(ADIE) )
+		AdcPending = 1;
+
+	if( ClockIoStopped )
+		ClockIoStart(); //ADC interrupt wakes up the CPU
+}
+
+/**
+ * Adds frame to the recording if \c HardwareBuffer has changed.
+ */
+static void RecordFrame()
+{
+	static size_t Capacity;
+
+	if( g_SimFrameCount &&
+		0 == memcmp( g_SimFrames[g_SimFrameCount-1].Hardware, (const void*)HardwareBuffer, 8 ) )
+		return;
+
+	if( g_SimFrameCount == Capacity )
+	{
+		Capacity = Capacity ? Capacity * 2 : 256;
+		g_SimFrames = realloc( g_SimFrames, Capacity * sizeof(SIMFRAME) );
+		if( !g_SimFrames )
+		{
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	SIMFRAME* pFrame = &g_SimFrames[ g_SimFrameCount++ ];
+	pFrame->Cycles = g_SimCycles;
+	memcpy( pFrame->Display, (const void*)DisplayBuffer, 8 );
+	memcpy( pFrame->Hardware, (const void*)HardwareBuffer, 8 );
+}
+
+/**
+ * Updates \ref g_SimMaskedMax when interrupts are enabled again.
+ */
+static void MaskedEnd()
+{
+	if( !InterruptsOn && g_SimCycles - MaskedStart > g_SimMaskedMax )
+		g_SimMaskedMax = g_SimCycles - MaskedStart;
+}
+
+/**
+ * Calls pending interrupt routines in order of hardware priority.
+ */
+static void Dispatch()
+{
+	while( InterruptsOn && !InIsr )
+	{
+		uint8_t hw[8];
+
+		memcpy( hw, (const void*)HardwareBuffer, 8 );
+
+		if( (PCIFR & _BV(PCIF1)) && (PCICR & _BV(PCIE1)) )
+		{
+			PCIFR &= ~_BV(PCIF1);
+			InIsr = 1;
+			InterruptsOn = 0;
+			MaskedStart = g_SimCycles;
+			if( PCINT1_vect )
+				PCINT1_vect();
+		}
+		else if( Timer2Flag && (TIMSK2 & _BV(OCIE2A)) )
+		{
+			Timer2Flag = 0;
+			InIsr = 1;
+			InterruptsOn = 0;
+			MaskedStart = g_SimCycles;
+			if( TIMER2_COMPA_vect )
+				TIMER2_COMPA_vect();
+		}
+		else if( (TIFR1 & _BV(ICF1)) && (TIMSK1 & _BV(ICIE1)) )
+		{
+			TIFR1 &= ~_BV(ICF1);
+			InIsr = 1;
+			InterruptsOn = 0;
+			MaskedStart = g_SimCycles;
+			if( TIMER1_CAPT_vect )
+				TIMER1_CAPT_vect();
+		}
+		else if( (TIFR1 & _BV(TOV1)) && (TIMSK1 & _BV(TOIE1)) )
+		{
+			TIFR1 &= ~_BV(TOV1);
+			InIsr = 1;
+			InterruptsOn = 0;
+			MaskedStart = g_SimCycles;
+			if( TIMER1_OVF_vect )
+				TIMER1_OVF_vect();
+		}
+		else if( Timer0Pending )
+		{
+			Timer0Pending = 0;
+			InIsr = 1;
+			InterruptsOn = 0;
+			MaskedStart = g_SimCycles;
+			if( TIMER0_OVF_vect )
+				TIMER0_OVF_vect();
+
+			if( memcmp( hw, (const void*)HardwareBuffer, 8 ) )
+				RecordFrame();
+		}
+		else if( AdcPending )
+		{
+			uint8_t ch = ADMUX & 7;
+			uint64_t t = SimHostCycles();
+
+			AdcPending = 0;
+			ADCSRA &= ~_BV(ADIF);
+			InIsr = 1;
+			InterruptsOn = 0;
+			MaskedStart = g_SimCycles;
+			if( ADC_vect )
+				ADC_vect();
+
+			g_SimAdcIsrCycles += SimHostCycles() - t;
+			g_SimAdcInterrupts[ch]++;
+		}
+		else
+		{
+			break;
+		}
+
+		SimRun( SIM_ISR_CYCLES );
+
+		MaskedEnd();
+		InterruptsOn = 1;
+		InIsr = 0;
+	}
+}
+
+/**
+ * Returns time of the next peripheral event.
+ */
+static uint64_t NextEvent( uint64_t end )
+{
+	uint64_t next = end;
+
+	if( ClockIoStopped )
+		; //timers do not count
+	else
+	{
+		if( Timer0Prescaler() && (TIMSK0 & _BV(TOIE0)) && Timer0Next < next )
+			next = Timer0Next;
+
+		if( Timer0Prescaler() && (ADCSRA & _BV(ADATE)) && Timer0Compare < next )
+			next = Timer0Compare;
+	}
+
+	if( !ClockIoStopped && Timer1Next && Timer1Next < next )
+		next = Timer1Next;
+
+	if( !ClockIoStopped && Timer2Running && Timer2Next() < next )
+		next = Timer2Next();
+
+	for( uint8_t i = 0; i < SIM_PULSES; i++ )
+	{
+		if( PulsePeriod[i] && PulseNext[i] < next )
+			next = PulseNext[i];
+	}
+
+	if( AdcRunning && AdcDone < next )
+		next = AdcDone;
+
+	return next;
+}
+
+/**
+ * \brief Runs simulation for the given time.
+ *
+ * Interrupts are served if enabled.
+ *
+ * \param cycles Number of CPU cycles.
+ */
+void SimRun( uint64_t cycles )
+{
+	uint64_t end = g_SimCycles + cycles;
+
+	SimOwUpdate();
+	Dispatch();
+
+	do
+	{
+		AdcCheckStart();
+
+		if( !Timer0Prescaler() )
+			Timer0Next = 0;
+		else if( !Timer0Next )
+		{
+			Timer0Next = g_SimCycles + 256 * Timer0Prescaler();
+			Timer0Compare = g_SimCycles + (OCR0A + 1) * Timer0Prescaler();
+		}
+
+		if( !Timer1Prescaler() )
+			Timer1Next = 0;
+		else if( !Timer1Next )
+		{
+			Timer1Start = g_SimCycles;
+			Timer1Next = g_SimCycles + 65536ULL * Timer1Prescaler();
+		}
+
+		if( !Timer2Prescaler() )
+			Timer2Running = 0;
+		else if( !Timer2Running )
+		{
+			Timer2Running = 1;
+			Timer2Start = g_SimCycles - (uint64_t)TCNT2 * Timer2Prescaler();
+			Timer2Checked = g_SimCycles;
+		}
+
+		uint64_t next = NextEvent( end );
+		if( next > g_SimCycles )
+			g_SimCycles = next;
+
+		if( TIFR0 & _BV(OCF0A) )
+		{
+			TIFR0 &= ~_BV(OCF0A);
+			Timer0CompareFlag = 0;
+		}
+
+		if( TIFR2 & _BV(OCF2A) )
+		{
+			TIFR2 &= ~_BV(OCF2A);
+			Timer2Flag = 0;
+		}
+
+		while( !ClockIoStopped && Timer0Next && Timer0Compare <= g_SimCycles )
+		{
+			Timer0Compare += 256 * Timer0Prescaler();
+			Timer0CompareMatch();
+		}
+
+		if( !ClockIoStopped && Timer0Next && Timer0Next <= g_SimCycles )
+		{
+			Timer0Next += 256 * Timer0Prescaler();
+			if( TIMSK0 & _BV(TOIE0) )
+			{
+				if( Timer0Pending )
+					g_SimTimer0Lost++;
+				Timer0Pending = 1;
+			}
+		}
+
+		if( !ClockIoStopped && Timer1Next && Timer1Next <= g_SimCycles )
+		{
+			Timer1Next += 65536ULL * Timer1Prescaler();
+			TIFR1 |= _BV(TOV1);
+		}
+
+		for( uint8_t i = 0; i < SIM_PULSES; i++ )
+		{
+			if( PulsePeriod[i] && PulseNext[i] <= g_SimCycles )
+				PulseEdge( i );
+		}
+
+		if( !ClockIoStopped && Timer2Running && Timer2Next() <= g_SimCycles )
+		{
+			Timer2Start = Timer2Next();
+			Timer2Flag = 1;
+		}
+
+		if( Timer2Running && !ClockIoStopped )
+			Timer2Checked = g_SimCycles;
+
+		if( AdcRunning && AdcDone <= g_SimCycles )
+			AdcComplete();
+
+		SimOwUpdate();
+		Dispatch();
+	} while( g_SimCycles < end );
+}
+
+/**
+ * One iteration of busy waiting loop.
+ */
+void SimIdle()
+{
+	SimRun( 8 );
+}
+
+/**
+ * Sleeps until the next interrupt.
+ */
+void SimSleep()
+{
+	if( !InterruptsOn )
+	{
+		fprintf( stderr, "Sleep with interrupts disabled\n" );
+		exit(1);
+	}
+
+	//interrupt routine may enable interrupts and sleep, nested interrupts are served
+	uint8_t isr = InIsr;
+
+	InIsr = 0;
+
+	if( (SMCR & (_BV(SM0)|_BV(SM1)|_BV(SM2))) == _BV(SM0) )
+	{
+		//ADC Noise Reduction, conversion starts and I/O clock stops
+		//until ADC interrupt, other wake up sources are not emulated
+		if( ADCSRA & _BV(ADEN) )
+		{
+			ADCSRA |= _BV(ADSC);
+			ClockIoStopped = 1;
+			ClockIoStop = g_SimCycles;
+		}
+
+		AdcCheckStart();
+	}
+	else
+	{
+		AdcCheckStart();
+	}
+
+	if( !Timer0Prescaler() && !Timer1Prescaler() && !Timer2Prescaler() && !AdcRunning )
+	{
+		fprintf( stderr, "Sleep without wake up source\n" );
+		exit(1);
+	}
+
+	uint64_t next = NextEvent( UINT64_MAX );
+
+	SimRun( next > g_SimCycles ? next - g_SimCycles : 1 );
+
+	InIsr = isr;
+}
+
+/**
+ * Disables interrupts.
+ * \return Previous state of the I flag.
+ */
+uint8_t SimCli()
+{
+	uint8_t sreg = InterruptsOn;
+
+	if( InterruptsOn )
+		MaskedStart = g_SimCycles;
+
+	InterruptsOn = 0;
+
+	return sreg;
+}
+
+/**
+ * Enables interrupts.
+ */
+void SimSei()
+{
+	MaskedEnd();
+	InterruptsOn = 1;
+	Dispatch();
+}
+
+/**
+ * Restores I flag saved by SimCli().
+ */
+void SimRestore( uint8_t sreg )
+{
+	if( sreg )
+		SimSei();
+	else
+		SimCli();
+}
+
+/**
+ * Clears recorded frames. Current content of \c HardwareBuffer
+ * becomes the first frame.
+ */
+void SimResetFrames()
+{
+	g_SimFrameCount = 0;
+	RecordFrame();
+}
+
+/**
+ * \brief Converts hardware buffer into picture visible on LED matrix.
+ *
+ * Uses wiring of rows and columns as in CopyDisplayToHardware0().
+ *
+ * \param hw Hardware buffer, index is PORTB bit, bits are PORTD bits.
+ * \param panel Output, rows from top, bit 7 is the leftmost column.
+ */
+static void HardwareToPanel( const uint8_t* hw, uint8_t* panel )
+{
+	//LED row (0 based) driven by PBx
+	static const uint8_t Row[8] = { 0, 5, 3, 1, 2, 4, 7, 6 };
+	//LED column (0 based) driven by PDx
+	static const uint8_t Col[8] = { 3, 1, 0, 2, 5, 6, 4, 7 };
+
+	memset( panel, 0, 8 );
+
+	for( uint8_t r = 0; r < 8; r++ )
+	{
+		for( uint8_t b = 0; b < 8; b++ )
+		{
+			if( hw[r] & (1 << b) )
+				panel[ Row[r] ] |= 0x80 >> Col[b];
+		}
+	}
+}
+
+/**
+ * \brief Returns host CPU time stamp.
+ *
+ * Time stamp counter on x86, nanoseconds elsewhere. Differences compare cost
+ * of firmware code on the host, they are not AVR cycles.
+ */
+uint64_t SimHostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * \brief Writes recorded frames as text.
+ *
+ * For every frame there is time of the commit, content of \c DisplayBuffer,
+ * picture visible on LED matrix and raw \c HardwareBuffer bytes.
+ *
+ * \param f Output file.
+ */
+void SimWriteLog( FILE* f )
+{
+	for( size_t i = 0; i < g_SimFrameCount; i++ )
+	{
+		const SIMFRAME* pFrame = &g_SimFrames[i];
+		uint8_t panel[8];
+
+		HardwareToPanel( pFrame->Hardware, panel );
+
+		fprintf( f, "frame %zu %.3f ms\n", i, pFrame->Cycles * 1000.0 / F_CPU );
+
+		for( uint8_t y = 0; y < 8; y++ )
+		{
+			for( uint8_t x = 0; x < 8; x++ )
+				fputc( pFrame->Display[y] & (0x80 >> x) ? '#' : '.', f );
+
+			fputc( ' ', f );
+
+			for( uint8_t x = 0; x < 8; x++ )
+				fputc( panel[y] & (0x80 >> x) ? '#' : '.', f );
+
+			fprintf( f, " 0x%02X\n", pFrame->Hardware[y] );
+		}
+	}
+}
+
+/**
+ * \brief Writes EEPROM variables as Intel HEX file.
+ *
+ * Variables declared with \c EEMEM are placed in \c eeprom section by the
+ * linker, the file looks like EEPROM read by a programmer. Order of variables
+ * may differ from the AVR build.
+ *
+ * \param f Output file.
+ */
+void SimWriteEeprom( FILE* f )
+{
+	extern uint8_t __start_eeprom[], __stop_eeprom[];
+	size_t size = __stop_eeprom - __start_eeprom;
+
+	for( size_t a = 0; a < size; a += 16 )
+	{
+		uint8_t n = size - a < 16 ? size - a : 16;
+		uint8_t sum = n + (a >> 8) + a;
+
+		fprintf( f, ":%02X%04zX00", n, a );
+
+		for( uint8_t i = 0; i < n; i++ )
+		{
+			fprintf( f, "%02X", __start_eeprom[a+i] );
+			sum += __start_eeprom[a+i];
+		}
+
+		fprintf( f, "%02X\n", (uint8_t)-sum );
+	}
+
+	fprintf( f, ":00000001FF\n" );
+}
+
+/**
+ * GIF LZW bit writer.
+ */
+typedef struct
+{
+	FILE* f;
+	uint8_t Block[255];
+	uint8_t Len;
+	uint32_t Bits;
+	uint8_t nBits;
+} GIFWRITER;
+
+static void GifFlushBlock( GIFWRITER* w )
+{
+	if( w->Len )
+	{
+		fputc( w->Len, w->f );
+		fwrite( w->Block, 1, w->Len, w->f );
+		w->Len = 0;
+	}
+}
+
+static void GifCode( GIFWRITER* w, unsigned code )
+{
+	w->Bits |= code << w->nBits;
+	w->nBits += 3;
+
+	while( w->nBits >= 8 )
+	{
+		w->Block[ w->Len++ ] = w->Bits & 0xFF;
+		w->Bits >>= 8;
+		w->nBits -= 8;
+
+		if( w->Len == sizeof(w->Block) )
+			GifFlushBlock( w );
+	}
+}
+
+static void Put16( FILE* f, unsigned v )
+{
+	fputc( v & 0xFF, f );
+	fputc( v >> 8, f );
+}
+
+/**
+ * \brief Writes recorded frames as animated GIF.
+ *
+ * The picture is what is visible on LED matrix. Frame delays
+ * come from commit times, rounded to 10ms as required by GIF.
+ *
+ * Image data is stored without compression: clear code is sent every
+ * 2 pixels, so the LZW code size never grows beyond 3 bits.
+ *
+ * \param f Output file.
+ */
+void SimWriteGif( FILE* f )
+{
+	const unsigned Size = 8 * SIM_GIF_SCALE;
+	const unsigned Clear = 4, Eoi = 5;
+	uint64_t shown = 0; //time already covered by written frames [10ms]
+
+	fwrite( "GIF89a", 1, 6, f );
+	Put16( f, Size );
+	Put16( f, Size );
+	fputc( 0x91, f ); //global color table, 4 entries
+	fputc( 0, f );
+	fputc( 0, f );
+
+	//palette: off, on, unused, unused
+	static const uint8_t Palette[12] = { 0x20,0x20,0x20, 0xFF,0x20,0x10, 0,0,0, 0,0,0 };
+	fwrite( Palette, 1, sizeof(Palette), f );
+
+	//loop forever
+	fwrite( "\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, f );
+
+	for( size_t i = 0; i < g_SimFrameCount; i++ )
+	{
+		uint8_t panel[8];
+		uint64_t end;
+
+		if( i + 1 < g_SimFrameCount )
+			end = g_SimFrames[i+1].Cycles * 100 / F_CPU;
+		else
+			end = g_SimFrames[i].Cycles * 100 / F_CPU + 100;
+
+		unsigned delay = end > shown ? end - shown : 0;
+		shown += delay;
+
+		HardwareToPanel( g_SimFrames[i].Hardware, panel );
+
+		//graphic control extension
+		fwrite( "\x21\xF9\x04\x00", 1, 4, f );
+		Put16( f, delay );
+		fputc( 0, f );
+		fputc( 0, f );
+
+		//image descriptor
+		fputc( 0x2C, f );
+		Put16( f, 0 );
+		Put16( f, 0 );
+		Put16( f, Size );
+		Put16( f, Size );
+		fputc( 0, f );
+
+		fputc( 2, f ); //LZW minimum code size
+
+		GIFWRITER w;
+		memset( &w, 0, sizeof(w) );
+		w.f = f;
+
+		unsigned n = 0;
+		for( unsigned y = 0; y < Size; y++ )
+		{
+			for( unsigned x = 0; x < Size; x++ )
+			{
+				if( 0 == n++ % 2 )
+					GifCode( &w, Clear );
+
+				GifCode( &w, panel[y/SIM_GIF_SCALE] & (0x80 >> x/SIM_GIF_SCALE) ? 1 : 0 );
+			}
+		}
+
+		GifCode( &w, Eoi );
+		if( w.nBits )
+		{
+			w.Block[ w.Len++ ] = w.Bits & 0xFF;
+		}
+		GifFlushBlock( &w );
+		fputc( 0, f ); //block terminator
+	}
+
+	fputc( 0x3B, f );
+}
+
+/**
+ * avr-libc itoa().
+ */
+char* itoa( int value, char* str, int radix )
+{
+	char tmp[18];
+	unsigned v = value < 0 && radix == 10 ? -value : (unsigned)value;
+	int i = 0;
+	char* p = str;
+
+	do
+	{
+		tmp[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[ v % radix ];
+		v /= radix;
+	} while( v );
+
+	if( value < 0 && radix == 10 )
+		*p++ = '-';
+
+	while( i )
+		*p++ = tmp[--i];
+
+	*p = 0;
+
+	return str;
+}
+
+/**
+ * avr-libc utoa().
+ */
+char* utoa( unsigned value, char* str, int radix )
+{
+	char tmp[18];
+	int i = 0;
+	char* p = str;
+
+	do
+	{
+		tmp[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[ value % radix ];
+		value /= radix;
+	} while( value );
+
+	while( i )
+		*p++ = tmp[--i];
+
+	*p = 0;
+
+	return str;
+}
+
+/** @} */
@@ -0,0 +1,98 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Host simulator of the GPI hardware.
+ *
+ * The header is included in front of every firmware source file
+ * compiled for the host (see \c sim/Makefile).
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * \defgroup sim Host simulator
+ * \brief Runs the firmware on PC with simulated timer0, timer1, ADC and LED display.
+ * @{
+ */
+
+/**
+ * Recorded display frame.
+ */
+typedef struct tagSIMFRAME
+{
+	uint64_t Cycles; ///< Time of the commit in CPU cycles
+	uint8_t Display[8]; ///< DisplayBuffer content
+	uint8_t Hardware[8]; ///< HardwareBuffer content
+} SIMFRAME;
+
+/**
+ * \name Pulse generator outputs
+ * @{
+ */
+#define SIM_PULSE_ICP1 0 ///< Timer1 input capture pin
+#define SIM_PULSE_PC0 1 ///< PC0, pin change interrupt PCINT8
+#define SIM_PULSES 2
+///@}
+
+/**
+ * Input high threshold of digital pins in 10-bit ADC units (0.6 VCC).
+ */
+#define SIM_INPUT_HIGH 614
+
+extern uint64_t g_SimCycles;
+extern uint16_t g_SimAnalog[8];
+extern uint8_t g_SimAdcNoise;
+extern unsigned long g_SimEepromWrites;
+extern unsigned long g_SimAdcConversions;
+extern unsigned long g_SimAdcInterrupts[8];
+extern uint64_t g_SimAdcIsrCycles;
+extern uint64_t g_SimMaskedMax;
+extern unsigned long g_SimTimer0Lost;
+
+extern SIMFRAME* g_SimFrames;
+extern size_t g_SimFrameCount;
+
+void SimRun( uint64_t cycles );
+void SimPulse( uint8_t output, uint64_t period );
+void SimSetPinC( uint8_t pins );
+uint16_t SimTimer1();
+void SimIdle();
+void SimSleep();
+
+uint8_t SimCli();
+void SimSei();
+void SimRestore( uint8_t sreg );
+uint64_t SimHostCycles();
+
+void SimResetFrames();
+void SimWriteLog( FILE* f );
+void SimWriteGif( FILE* f );
+void SimWriteEeprom( FILE* f );
+
+char* itoa( int value, char* str, int radix );
+char* utoa( unsigned value, char* str, int radix );
+
+/** @} */
+
+#endif /* SIM_H_ */
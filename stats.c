@@ -0,0 +1,180 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Gearbox usage statistics
+ */
+
+#include <string.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include "stats.h"
+#include "gpi.h"
+#include "display.h"
+#include "crc8.h"
+
+/**
+ * \defgroup stats Gearbox usage statistics
+ * \brief Time spent in every gear and histogram of shift duration.
+ *
+ * Main loop passes the displayed gear to StatsGear(), the time since the previous
+ * call is added to that gear. Shift tracking passes duration of every completed
+ * shift to StatsShift(), from leaving a stable gear level to the next stable level.
+ * Counters are kept in RAM and stored in EEPROM every \ref STATS_SAVE_MINUTES of
+ * riding. Up to \ref STATS_SAVE_MINUTES are lost at power off.
+ * @{
+ */
+
+/** Statistics in RAM */
+STATS g_Stats;
+
+/// Ticks not yet counted as a second
+static uint16_t StatsTicks;
+/// Seconds not yet counted as a minute, for every gear
+static uint8_t StatsSeconds[MAX_GEAR_NUMBER+1];
+/// Minutes counted since the last StatsSave()
+static uint8_t StatsUnsaved;
+
+/**
+ * Layout of statistics in EEPROM.
+ */
+typedef struct
+{
+	STATS Stats; ///< Counters
+	uint8_t Crc; ///< crc8() of \a Stats
+} STATS_EEPROM;
+
+/** Statistics in EEPROM, written by StatsSave() */
+static STATS_EEPROM EEMEM ee_Stats;
+
+/**
+ * \brief Reads statistics from EEPROM.
+ *
+ * Counters are cleared if CRC does not match (mostly empty EEPROM).
+ */
+void StatsRead()
+{
+	eeprom_read_block( &g_Stats, &ee_Stats.Stats, sizeof(STATS) );
+
+	if( crc8( (uint8_t*)&g_Stats, sizeof(STATS) ) != eeprom_read_byte( &ee_Stats.Crc ) )
+		memset( &g_Stats, 0, sizeof(STATS) );
+}
+
+/**
+ * \brief Stores statistics in EEPROM.
+ *
+ * Only changed bytes are written, usually low bytes of a few counters.
+ */
+void StatsSave()
+{
+	STATS stats;
+
+	//shift histogram is updated by ADC interrupt
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		stats = g_Stats;
+	}
+
+	eeprom_update_block( &stats, &ee_Stats.Stats, sizeof(STATS) );
+	eeprom_update_byte( &ee_Stats.Crc, crc8( (uint8_t*)&stats, sizeof(STATS) ) );
+
+	StatsUnsaved = 0;
+}
+
+/**
+ * \brief Clears all counters in RAM and EEPROM.
+ */
+void StatsClear()
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		memset( &g_Stats, 0, sizeof(STATS) );
+	}
+
+	memset( StatsSeconds, 0, sizeof(StatsSeconds) );
+
+	StatsSave();
+}
+
+/**
+ * \brief Counts time in gear.
+ *
+ * Called from the main loop, at least once per second. Costs a subtraction and
+ * an addition, seconds and minutes are counted once per second.
+ * Longer gaps (e.g. menu) are counted as one second.
+ *
+ * \param gear Displayed gear, 0 is neutral. Other values are ignored.
+ */
+void StatsGear( uint8_t gear )
+{
+	static uint16_t last;
+
+	uint16_t now = GetTicks();
+	uint16_t elapsed = now - last;
+
+	last = now;
+
+	if( gear > MAX_GEAR_NUMBER )
+		return;
+
+	if( elapsed > TICKS_PER_SECOND )
+		elapsed = TICKS_PER_SECOND;
+
+	StatsTicks += elapsed;
+	if( StatsTicks < TICKS_PER_SECOND )
+		return;
+
+	StatsTicks -= TICKS_PER_SECOND;
+
+	if( ++StatsSeconds[gear] < 60 )
+		return;
+
+	StatsSeconds[gear] = 0;
+
+	if( g_Stats.Minutes[gear] < 0xFFFF )
+		g_Stats.Minutes[gear]++;
+
+	if( ++StatsUnsaved >= STATS_SAVE_MINUTES )
+		StatsSave();
+}
+
+/**
+ * \brief Counts one shift in the duration histogram.
+ *
+ * Called by shift tracking when the shift ends, from ADC interrupt or from
+ * GetGear() for ratio decoder.
+ *
+ * \param ticks Duration of the shift in \ref g_Ticks or \ref STATS_SHIFT_CANCELLED.
+ */
+void StatsShift( uint16_t ticks )
+{
+	uint8_t b = 0;
+
+	//position of the highest bit
+	ticks >>= STATS_SHIFT_BITS;
+	while( ticks && b < STATS_SHIFT_BUCKETS-1 )
+	{
+		ticks >>= 1;
+		b++;
+	}
+
+	if( g_Stats.Shifts[b] < 0xFFFF )
+		g_Stats.Shifts[b]++;
+}
+
+/** @} */
@@ -0,0 +1,69 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Gearbox usage statistics header
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * \name Shift duration histogram
+ * Bucket \a b counts shifts shorter than 2^(\ref STATS_SHIFT_BITS + b) ticks,
+ * ca 4ms, 8ms, 16ms ... 262ms at \ref TICKS_PER_SECOND of 31250. The last bucket
+ * counts shifts cancelled after \ref SHIFT_TIMEOUT.
+ * @{
+ */
+/// Number of buckets
+#define STATS_SHIFT_BUCKETS 8
+/// Upper limit of the first bucket is 2^STATS_SHIFT_BITS ticks
+#define STATS_SHIFT_BITS 7
+/// Duration passed to StatsShift() for cancelled shift
+#define STATS_SHIFT_CANCELLED 0xFFFF
+///@}
+
+/**
+ * Minutes of riding between writes to EEPROM. Every write changes a few bytes
+ * only, 100000 write cycles of EEPROM cell last 25000 hours of riding.
+ */
+#define STATS_SAVE_MINUTES 15
+
+/**
+ * Gearbox usage statistics, stored in EEPROM.
+ *
+ * All counters saturate at 0xFFFF.
+ */
+typedef struct tagSTATS
+{
+	uint16_t Minutes[MAX_GEAR_NUMBER+1]; ///< Time in gear [min], index 0 is neutral, max 1092h
+	uint16_t Shifts[STATS_SHIFT_BUCKETS]; ///< Histogram of shift duration, see \ref STATS_SHIFT_BUCKETS
+} STATS;
+
+extern STATS g_Stats;
+
+void StatsRead();
+void StatsSave();
+void StatsClear();
+void StatsGear( uint8_t gear );
+void StatsShift( uint16_t ticks );
+
+#endif /* STATS_H_ */
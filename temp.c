@@ -27,6 +27,7 @@
  */
 
 #include <avr/pgmspace.h>
+#include <avr/eeprom.h>
 #include <avr/sleep.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
@@ -38,53 +39,160 @@
 #include "display.h"
 #include "config.h"
 #include "adc.h"
+#include "onewire.h"
 
 /**
- * Current temperature in Celsius * 10.
- * Updated every time by GetTempConversionResult()
+ * Current temperature of every sensor in Celsius * 10.
+ * Updated every time by UpdateTemperature()
  * It can be \ref INVALID_TEMP in case of reading problems.
  *
- * @sa GetTempConversionResult()
+ * @sa UpdateTemperature()
  */
 
-int16_t g_nTemperature = INVALID_TEMP;
+int16_t g_nTemperature[ TEMP_SENSORS ] = { INVALID_TEMP, INVALID_TEMP, INVALID_TEMP };
+
+/**
+ * \name Measurement states
+ * See UpdateTemperature().
+ * @{
+ */
+/// Nothing runs, the next conversion starts
+#define TEMP_IDLE 0
+/// Sending convert command
+#define TEMP_CONVERT 1
+/// Sensors convert temperature
+#define TEMP_WAIT 2
+/// Reading scratchpad of \a TempSensor
+#define TEMP_READ 3
+/// Writing configuration register
+#define TEMP_CONFIGURE 4
+///@}
+
+/// Number of bytes of DS18B20 scratchpad, the last one is CRC
+#define TEMP_SCRATCHPAD 9
+
+/// Index of configuration register in scratchpad
+#define TEMP_CONFIG_INDEX 4
+
+/// Configuration register of \ref TEMP_RESOLUTION, resolution in bits 5 and 6
+#define TEMP_CONFIG ( ((TEMP_RESOLUTION-9) << 5) | 0x1F )
+
+/**
+ * \name Alarm thresholds
+ * Written with configuration register, alarm search is not used.
+ * Not copied to sensor EEPROM.
+ * @{
+ */
+#define TEMP_ALARM_HIGH 0x7F
+#define TEMP_ALARM_LOW 0x80
+///@}
+
+#ifdef TEMP_FAST_READ
+/// Number of bytes of fast read, temperature only
+#define TEMP_FAST_BYTES 2
+
+/// The largest change of fast read from the previous reading [Celsius*10]
+#define TEMP_FAST_DELTA 20
+
+/// Every this conversion all sensors are read with CRC, configuration register is checked
+#define TEMP_FULL_ROUNDS 16
+
+/// Temperature register after power up, 85C, never accepted without CRC
+#define TEMP_POWER_UP_RAW 0x0550
+#endif
+
+/// Conversion time in \ref g_Ticks
+#define TEMP_CONVERSION_TICKS ( (uint32_t)TEMP_CONVERSION_MS * TICKS_PER_SECOND / 1000 )
+
+/// Number of measurements in a row with a sensor not answering before the bus is searched again
+#define TEMP_VERIFY_FAILS 3
+
+/// Current measurement step, e.g. \ref TEMP_WAIT
+static uint8_t TempState = TEMP_IDLE;
+/// Time the conversion started, \ref g_Ticks
+static uint16_t TempStart;
+/// Sensor being read, index to \ref g_nTemperature
+static uint8_t TempSensor;
+/// Number of sensors with known ROM code, 0 if the only sensor is addressed by SKIP ROM
+static uint8_t TempCount;
+/// Number of measurements in a row with a sensor not answering, see TempCheckRom()
+static uint8_t TempMisses;
+/// A sensor did not answer in this measurement
+static uint8_t TempMissed;
+/// Configuration register must be written, sensor resolution is not \ref TEMP_RESOLUTION
+static uint8_t TempConfigure = 1;
+#ifdef TEMP_FAST_READ
+/// Scratchpad being read is complete, with CRC
+static uint8_t TempFull;
+/// Conversions since the last round of full reads, the first round is full
+static uint8_t TempRound = TEMP_FULL_ROUNDS-1;
+#else
+#define TempFull 1
+#endif
+/// ROM codes of sensors, in order of ROM search
+static uint8_t TempRom[ TEMP_SENSORS ][ OW_ROM_SIZE ];
+/// 1-Wire commands followed by scratchpad
+static uint8_t TempBuffer[ 2 + OW_ROM_SIZE + TEMP_SCRATCHPAD ];
+
+/**
+ * ROM codes stored in EEPROM.
+ */
+typedef struct
+{
+	uint8_t Count; ///< Number of sensors found
+	uint8_t Rom[ TEMP_SENSORS ][ OW_ROM_SIZE ]; ///< ROM codes
+	uint8_t Crc; ///< crc8() of \a Rom followed by \a Count
+} TEMP_EEPROM;
+
+/** ROM codes found by the last search, see TempInit() */
+static TEMP_EEPROM EEMEM ee_TempRom;
 
 /**
  * @brief Format temperature into string.
  *
  * Result stored in g_TextBuffer. Length of text is set g_TextBufferLen.
- * String is formatted based on configuration settings.
+ * String is formatted based on configuration settings. Number of the sensor
+ * precedes temperature if there are more sensors, e.g. " 2:90.5~C".
  *
+ * \param sensor Index to \ref g_nTemperature, less than TempSensors().
  * \return Length of the formatted string without terminating 0.
  * @sa g_Config
 */
 
-int FormatTemperature()
+int FormatTemperature( uint8_t sensor )
 {
 	int temp;
-	PGM_P szInvalidTemp = " ??~C";
+	int16_t value = g_nTemperature[ sensor ];
 
 	if( g_Config.fTempFahrenheitOn )
 	{
 		//convert from Fahrenheit
-		temp = g_nTemperature * 9;
+		temp = value * 9;
 		temp /= 5;
 		temp += 32;
 	}
 	else
 	{
-		temp = g_nTemperature;
+		temp = value;
 	}
 
+	size_t start = 1;
+
+	g_TextBuffer[0] = ' ';
 
-	if( g_nTemperature == INVALID_TEMP )
+	if( TempCount > 1 )
 	{
-		//memcpy_P( g_TextBuffer, szInvalidTemp, sizeof(szInvalidTemp )-1 );
-		strcpy_P( g_TextBuffer, szInvalidTemp);
-		return sizeof(szInvalidTemp)-1;
+		g_TextBuffer[1] = '1' + sensor;
+		g_TextBuffer[2] = ':';
+		start = 3;
 	}
 
-	g_TextBuffer[0] = ' ';
+	if( value == INVALID_TEMP )
+	{
+		strcpy_P( g_TextBuffer + start, PSTR("??~C") );
+		g_TextBufferLen = strlen( g_TextBuffer );
+		return g_TextBufferLen;
+	}
 
 	size_t index;
 
@@ -102,15 +210,15 @@ int FormatTemperature()
 		{
 			t-= (f >= 5 ? 1:0);
 		}
-		itoa( t, g_TextBuffer+1, 10 );
-		index = strlen( g_TextBuffer + 1 ) + 1;
+		itoa( t, g_TextBuffer+start, 10 );
+		index = strlen( g_TextBuffer + start ) + start;
 	}
 	else
 	{
 		//long format
 
-		itoa( temp/10, g_TextBuffer+1, 10 );
-		index = strlen( g_TextBuffer + 1 ) + 1;
+		itoa( temp/10, g_TextBuffer+start, 10 );
+		index = strlen( g_TextBuffer + start ) + start;
 
 		g_TextBuffer[index++] = g_Config.fUseComma ? ',' : '.';
 
@@ -128,6 +236,7 @@ int FormatTemperature()
 /**
  * @brief Displays current temperature on LED.
  *
+ * Temperature of every sensor is scrolled one after another.
  * Scrolling speed have to be the same as in TemperatureLoop() function.
  * In general, it should be impossible to see the difference when temperature is shown
  * by both functions.
@@ -138,207 +247,430 @@ void DisplayTemperature()
 
 	pCurrentFont = FONTTAB;
 
-	if( GetTempConversionResult() )
-		g_nTemperature = INVALID_TEMP;
-
-	FormatTemperature();
-
-	do
-	{
-		ScrollLeft(g_TextBuffer, g_TextBufferLen, &offset);
-		SCROLL_DELAY;
-	} while( offset );
-}
-
-/**
- * @brief Start DS18B20 temperature conversion.
- *
- * It takes 750ms to convert temperature. Conversion result must be obtained
- * using GetTempConversionResult().
- *
- * @warning Function disable and enable interrupts.
- * @return 0 for success.
- */
-uint8_t StartTempConversion()
-{
-	uint8_t err = ow_reset();
-
-	if( err )
+	//the first measurement after power up is not finished yet
+	while( INVALID_TEMP == g_nTemperature[0] && (TEMP_IDLE != TempState || OW_BUSY == OwStatus()) )
 	{
-		return err; //error
+		UpdateTemperature();
+		sleep_mode();
 	}
 
-	ow_byte_wr( OW_SKIP_ROM );
-	ow_byte_wr( OW_CONVERT );
+	for( uint8_t i = 0; i < TempSensors(); i++ )
+	{
+		FormatTemperature( i );
 
-	return 0; //success
+		do
+		{
+			ScrollLeft(g_TextBuffer, g_TextBufferLen, &offset);
+			ScrollDelay( &offset );
+		} while( offset );
+	}
 }
 
 /**
  * @brief Convert raw DS18B20 data to temperature integer.
- * Function works properly only for 12 bit result.
  *
- * @param raw Pointer to raw data (2 first bytes) of 12 bit reading.
+ * Raw reading is Celsius * 16 for every resolution, undefined low bits of
+ * 9 to 11 bit result are cleared. Result is rounded to the nearest 0.1C.
+ *
+ * @param raw Pointer to raw data (2 first bytes) of reading.
+ * @param config Configuration register the reading was converted with, resolution in bits 5 and 6.
  * @return Temperature * 10 in Celsius degrees, e.g. -10.6C = -106
  */
-inline int16_t Raw2Temp( uint8_t* raw )
+inline int16_t Raw2Temp( uint8_t* raw, uint8_t config )
 {
 	int16_t temp;
 
+	//undefined bits: 3 for 9-bit, 0 for 12-bit result
+	uint8_t undefined = 3 - ((config >> 5) & 3);
+
 	temp = raw[0] | (raw[1] << 8);
+	temp &= ~((1 << undefined) - 1);
 	temp *= 10;
+	temp += temp < 0 ? -8 : 8;
 	temp /= 16;
 
 	return temp;
 }
 
 /**
- * @brief Get temperature from DS18B20 sensor.
- *
- * As result \ref g_nTemperature is set.
- * Temperature conversion must be initiated by StartTempConversion(). Function can read
- * temperature 750ms after calling StartTempConversion();
+ * @brief Finds ROM codes of all sensors on the bus.
  *
- * @warning Function disable and enable interrupts.
+ * ROM search of Maxim application note 187. Every pass resets the bus and
+ * walks the 64 bits of ROM code: all sensors send the bit and its complement,
+ * both 0 means sensors differ in this bit. The first pass takes 0 at every
+ * discrepancy, the next pass repeats the path up to the last discrepancy where
+ * 0 was taken and takes 1 there.
  *
- * @retval 0 success.
- * @retval 1 reset error
- * @retval 2 CRC error
+ * Waits for every transfer, ca 15ms per sensor. Called only if ROM codes are
+ * not known or a sensor does not answer, see TempSearchSave().
  *
- * @sa StartTempConversion()
+ * \param pRom Found ROM codes, \ref TEMP_SENSORS entries.
+ * \return Number of sensors found.
  */
-uint8_t GetTempConversionResult()
+static uint8_t TempSearch( uint8_t (*pRom)[ OW_ROM_SIZE ] )
 {
-	const uint8_t BytesToRead = 9;
-	uint8_t rawtemp[ BytesToRead ];
-	uint8_t err;
+	uint8_t rom[ OW_ROM_SIZE ];
+	uint8_t last = 0; //position of the last discrepancy where 0 was taken, 1..64
+	uint8_t n = 0;
+	uint8_t b;
 
-	err = ow_reset();
-	if( err )
-		return err;
+	do
+	{
+		uint8_t zero = 0;
+		uint8_t crc = 0;
 
-	ow_byte_wr( OW_SKIP_ROM );
-	ow_byte_wr( OW_READ );
+		b = OW_SEARCH_ROM;
+		OwTransfer( &b, 1, 0 );
+		if( OW_OK != OwWait() )
+			break; //no sensor
 
-	for( uint8_t i = 0; i < BytesToRead; i++ )
-	{
-		rawtemp[i] = ow_byte_rd();
-	}
+		for( uint8_t i = 1; i <= OW_ROM_SIZE*8; i++ )
+		{
+			uint8_t* p = rom + ((i-1) >> 3);
+			uint8_t mask = 1 << ((i-1) & 7);
+
+			//bit and its complement
+			OwBits( &b, 0, 2 );
+			OwWait();
+			b &= 3;
+
+			if( 3 == b )
+				return n; //sensor disconnected
+
+			if( 0 == b )
+			{
+				//discrepancy
+				if( i < last )
+					b = (*p & mask) ? 1 : 0;
+				else
+					b = i == last;
+
+				if( !b )
+					zero = i;
+			}
+			else
+			{
+				b &= 1;
+			}
+
+			if( b )
+				*p |= mask;
+			else
+				*p &= ~mask;
+
+			//selected direction, sensors with the other bit stop
+			OwBits( &b, 1, 0 );
+
+			//CRC of completed byte while the slot runs, the last byte is CRC
+			if( mask == 0x80 )
+				crc = crc8_update( crc, *p );
+
+			OwWait();
+		}
 
-	if ( crc8( rawtemp, BytesToRead-1 ) != rawtemp[BytesToRead-1] )
-	{
-		return 2; //crc error
-	}
+		last = zero;
 
-	//convert temp from raw data to int
-	g_nTemperature = Raw2Temp(rawtemp);
+		//family code 0 is read from shorted bus
+		if( !crc && rom[0] )
+			memcpy( pRom[ n++ ], rom, OW_ROM_SIZE );
 
-	return 0; //success
+	} while( last && n < TEMP_SENSORS );
+
+	return n;
 }
 
 /**
- * \name 1wire low level
- * Based on Peter Dannegger code
- * @{
+ * @brief Computes CRC of ROM codes and their number as stored in EEPROM.
  */
+static uint8_t TempRomCrc()
+{
+	return crc8_update( crc8( (uint8_t*)TempRom, sizeof(TempRom) ), TempCount );
+}
 
 /**
- * 1-wire bus reset
- * @return
+ * @brief Searches the bus and stores found ROM codes in EEPROM.
+ *
+ * EEPROM is written only if the found sensors differ from the stored ones.
+ * If no sensor answers, e.g. bus drops out for a while, the known sensors
+ * are kept.
  */
-uint8_t ow_reset(void)
+static void TempSearchSave()
 {
-	uint8_t err;
+	uint8_t rom[ TEMP_SENSORS ][ OW_ROM_SIZE ];
+	uint8_t n = TempSearch( rom );
+
+	if( !n )
+		return;
 
-	OW_OUT_LOW();
-	OW_DIR_OUT(); // pull OW-Pin low for 480us
-	_delay_us(480);
+	memcpy( TempRom, rom, n * OW_ROM_SIZE );
+	TempCount = n;
 
-	cli(); //disable interrupts
+	if( TempCount == eeprom_read_byte( &ee_TempRom.Count ) )
+	{
+		const uint8_t* p = (const uint8_t*)TempRom;
+		uint8_t i;
 
-	// set Pin as input - wait for clients to pull low
-	OW_DIR_IN(); // input
-	OW_OUT_HIGH(); //internal pull-up
+		for( i = 0; i < TempCount * OW_ROM_SIZE; i++ )
+		{
+			if( p[i] != eeprom_read_byte( (const uint8_t*)ee_TempRom.Rom + i ) )
+				break;
+		}
 
-	_delay_us(64); // was 66
-	err = OW_GET_IN(); // no presence detect
-	// if err!=0: nobody pulled to low, still high
+		if( i == TempCount * OW_ROM_SIZE )
+			return; //the same sensors
+	}
 
-	sei(); //re-enable interrupts
+	eeprom_update_byte( &ee_TempRom.Count, TempCount );
+	eeprom_update_block( TempRom, ee_TempRom.Rom, sizeof(TempRom) );
+	eeprom_update_byte( &ee_TempRom.Crc, TempRomCrc() );
+}
 
-	// after a delay the clients should release the line
-	// and input-pin gets back to high by pull-up-resistor
-	_delay_us(480 - 64); // was 480-66
-	if (OW_GET_IN() == 0)
+/**
+ * @brief Checks known sensors after every measurement.
+ *
+ * The bus is searched again after \ref TEMP_VERIFY_FAILS measurements in a row
+ * with a missing sensor, at any time: ROM codes from EEPROM may belong to
+ * replaced sensors, a sensor may be removed or added. A single measurement
+ * can fail on noise.
+ *
+ * \param missed A sensor did not answer in the measurement.
+ */
+static void TempCheckRom( uint8_t missed )
+{
+	if( !missed )
 	{
-		err = 1; // short circuit, expected low but got high
+		TempMisses = 0; //all sensors answered
 	}
+	else if( ++TempMisses >= TEMP_VERIFY_FAILS )
+	{
+		TempMisses = 0;
+		TempSearchSave(); //sensor replaced or removed
+	}
+}
 
-	return err;
+/**
+ * @brief Reads ROM codes of sensors from EEPROM or finds them.
+ *
+ * ROM search runs only if EEPROM holds no valid ROM code, e.g. the first power
+ * up. If a sensor does not answer in \ref TEMP_VERIFY_FAILS measurements
+ * in a row, the bus is searched again, see TempCheckRom(). Sensors are numbered
+ * in order of their ROM codes. Must be called with interrupts enabled.
+ */
+void TempInit()
+{
+	TempCount = eeprom_read_byte( &ee_TempRom.Count );
+	eeprom_read_block( TempRom, ee_TempRom.Rom, sizeof(TempRom) );
+
+	if( !TempCount || TempCount > TEMP_SENSORS ||
+		TempRomCrc() != eeprom_read_byte( &ee_TempRom.Crc ) )
+	{
+		TempCount = 0; //the only sensor by SKIP ROM if none is found
+		TempSearchSave();
+	}
 }
 
-uint8_t ow_bit_io(uint8_t b)
+/**
+ * @brief Returns number of sensors.
+ *
+ * \return Number of valid entries in \ref g_nTemperature, at least 1.
+ */
+uint8_t TempSensors()
 {
-	cli();
+	return TempCount ? TempCount : 1;
+}
 
-	OW_OUT_LOW(); //pull-up
+/**
+ * @brief Starts reading scratchpad of \ref TempSensor.
+ *
+ * Sensor is addressed by MATCH ROM, if no ROM code is known the only sensor
+ * is addressed by SKIP ROM. Fast read stops after temperature, sensor stops
+ * sending at the reset of the next transfer.
+ */
+static void TempRead()
+{
+	uint8_t n = 0;
 
-	OW_DIR_OUT(); // drive bus low
-	_delay_us(2); // T_INT > 1usec accoding to timing-diagramm
-	if (b & 1)
+	if( TempCount )
 	{
-		OW_DIR_IN(); // to write "1" release bus, resistor pulls high
-
-		OW_OUT_HIGH(); //internal pull-up
+		TempBuffer[ n++ ] = OW_MATCH_ROM;
+		memcpy( TempBuffer + n, TempRom[ TempSensor ], OW_ROM_SIZE );
+		n += OW_ROM_SIZE;
+	}
+	else
+	{
+		TempBuffer[ n++ ] = OW_SKIP_ROM;
 	}
 
-	// "Output data from the DS18B20 is valid for 15usec after the falling
-	// edge that initiated the read time slot. Therefore, the master must
-	// release the bus and then sample the bus state within 15ussec from
-	// the start of the slot."
-	_delay_us(15 - 2 - OW_CONF_DELAYOFFSET);
+	TempBuffer[ n++ ] = OW_READ;
 
-	if (OW_GET_IN() == 0)
+#ifdef TEMP_FAST_READ
+	if( !TempFull )
 	{
-		b = 0; // sample at end of read-timeslot
+		OwTransfer( TempBuffer, n, TEMP_FAST_BYTES );
+		return;
 	}
+#endif
 
-	_delay_us(60 - 15 - 2 + OW_CONF_DELAYOFFSET);
-
-	OW_OUT_HIGH(); //pull-up
+	OwTransfer( TempBuffer, n, TEMP_SCRATCHPAD );
+}
 
-	OW_DIR_IN();
+#ifdef TEMP_FAST_READ
+/**
+ * @brief Checks fast read of \ref TempSensor without CRC.
+ *
+ * Temperature must be sign extended 12-bit value, not the power up value,
+ * and close to the previous reading. A sensor without valid reading is
+ * always read with CRC.
+ *
+ * @param pad Temperature bytes of scratchpad.
+ * @return Non zero if the reading can be used.
+ */
+static uint8_t TempPlausible( uint8_t* pad )
+{
+	int16_t prev = g_nTemperature[ TempSensor ];
+	uint8_t sign = pad[1] & 0xF8;
 
-	sei();
+	if( INVALID_TEMP == prev || (0 != sign && 0xF8 != sign) )
+		return 0;
 
-	_delay_us(OW_RECOVERY_TIME); // may be increased for longer wires
+	if( TEMP_POWER_UP_RAW == (pad[0] | (pad[1] << 8)) )
+		return 0;
 
-	return b;
+	return abs( Raw2Temp( pad, TEMP_CONFIG ) - prev ) <= TEMP_FAST_DELTA;
 }
+#endif
 
-uint8_t ow_byte_wr(uint8_t b)
+/**
+ * @brief Measures temperature in background.
+ *
+ * Called from the main loop as often as possible, never waits. Starts
+ * conversion of all sensors at once by SKIP ROM, after \ref TEMP_CONVERSION_MS
+ * reads results of sensors one by one and starts the next conversion.
+ * 1-Wire transfers run in background, see OwTransfer().
+ *
+ * Sensors power up with resolution stored in their EEPROM, 12 bits by default.
+ * Configuration register is written before the first conversion and whenever
+ * a sensor reports other resolution than \ref TEMP_RESOLUTION, e.g. after
+ * power loss of the sensor.
+ *
+ * With \ref TEMP_FAST_READ only temperature bytes are read, without CRC,
+ * 12 instead of 19 bytes with MATCH ROM, 4 instead of 11 with SKIP ROM.
+ * Reading that is not plausible is read again with CRC, see TempPlausible().
+ * Every \ref TEMP_FULL_ROUNDS conversion all sensors are read with CRC.
+ *
+ * As result \ref g_nTemperature is set, \ref INVALID_TEMP if the sensor does
+ * not answer or CRC is wrong.
+ */
+void UpdateTemperature()
 {
-	uint8_t i = 8, j;
+	uint8_t status = OwStatus();
 
-	do
+	if( OW_BUSY == status )
+		return;
+
+	switch( TempState )
 	{
-		j = ow_bit_io(b & 1);
-		b >>= 1;
-		if (j)
+	case TEMP_IDLE:
+		if( TempConfigure )
 		{
-			b |= 0x80;
+			//the same resolution for all sensors
+			TempBuffer[0] = OW_SKIP_ROM;
+			TempBuffer[1] = OW_WRITE;
+			TempBuffer[2] = TEMP_ALARM_HIGH;
+			TempBuffer[3] = TEMP_ALARM_LOW;
+			TempBuffer[4] = TEMP_CONFIG;
+			OwTransfer( TempBuffer, 5, 0 );
+			TempConfigure = 0;
+			TempState = TEMP_CONFIGURE;
+			break;
 		}
-	} while (--i);
+		//no break
 
-	return b;
-}
+	case TEMP_CONFIGURE:
+		TempBuffer[0] = OW_SKIP_ROM;
+		TempBuffer[1] = OW_CONVERT;
+		OwTransfer( TempBuffer, 2, 0 );
+		TempState = TEMP_CONVERT;
+		break;
 
-uint8_t ow_byte_rd( void )
-{
-	// read by sending only "1"s, so bus gets released
-	// after the init low-pulse in every slot
-	return ow_byte_wr( 0xFF );
+	case TEMP_CONVERT:
+		if( OW_OK != status )
+		{
+			for( uint8_t i = 0; i < TEMP_SENSORS; i++ )
+				g_nTemperature[i] = INVALID_TEMP;
+
+			TempCheckRom( 1 );
+			TempState = TEMP_IDLE;
+			break;
+		}
+
+		TempStart = GetTicks();
+		TempState = TEMP_WAIT;
+		break;
+
+	case TEMP_WAIT:
+		if( (uint16_t)(GetTicks() - TempStart) < TEMP_CONVERSION_TICKS )
+			break;
+
+#ifdef TEMP_FAST_READ
+		if( ++TempRound >= TEMP_FULL_ROUNDS )
+			TempRound = 0;
+
+		TempFull = !TempRound;
+#endif
+		TempSensor = 0;
+		TempMissed = 0;
+		TempRead();
+		TempState = TEMP_READ;
+		break;
+
+	case TEMP_READ:
+	{
+		uint8_t* pad = TempBuffer + (TempCount ? 2 + OW_ROM_SIZE : 2);
+
+		if( !TempFull )
+		{
+#ifdef TEMP_FAST_READ
+			if( OW_OK != status || !TempPlausible( pad ) )
+			{
+				//read the same result again with CRC
+				TempFull = 1;
+				TempRead();
+				break;
+			}
+
+			g_nTemperature[ TempSensor ] = Raw2Temp( pad, TEMP_CONFIG );
+#endif
+		}
+		else if( OW_OK != status || crc8( pad, TEMP_SCRATCHPAD-1 ) != pad[ TEMP_SCRATCHPAD-1 ] )
+		{
+			g_nTemperature[ TempSensor ] = INVALID_TEMP;
+		}
+		else
+		{
+			g_nTemperature[ TempSensor ] = Raw2Temp( pad, pad[ TEMP_CONFIG_INDEX ] );
+
+			if( TEMP_CONFIG != pad[ TEMP_CONFIG_INDEX ] )
+				TempConfigure = 1;
+		}
+
+		if( INVALID_TEMP == g_nTemperature[ TempSensor ] )
+			TempMissed = 1;
+
+		if( ++TempSensor < TempCount )
+		{
+#ifdef TEMP_FAST_READ
+			TempFull = !TempRound;
+#endif
+			TempRead();
+			break;
+		}
+
+		TempCheckRom( TempMissed );
+		TempState = TEMP_IDLE;
+		break;
+	}
+	}
 }
 
 ///@}
-///@}
@@ -25,50 +25,50 @@
 #ifndef TEMP_H_
 #define TEMP_H_
 
+#include "onewire.h"
+
 /**
  * @brief Invalid temperature value.
  */
 #define INVALID_TEMP 9999
 
-extern int16_t g_nTemperature;
+#ifndef TEMP_RESOLUTION
+/**
+ * Selected DS18B20 resolution in bits, from 9 to 12.
+ * 9 bits (0.5C) converts in 94ms, every next bit doubles the time.
+ * Display shows 0.1C, 10 bits (0.25C) is enough.
+ */
+#define TEMP_RESOLUTION 10
+#endif
 
-/* One wire */
+#if TEMP_RESOLUTION < 9 || TEMP_RESOLUTION > 12
+#error "DS18B20 resolution is 9 to 12 bits"
+#endif
 
-#define OW_PIN  PC5
-#define OW_IN   PINC
-#define OW_OUT  PORTC
-#define OW_DDR  DDRC
-#define OW_CONF_DELAYOFFSET 0
-#define OW_RECOVERY_TIME 10 /* usec */
+/**
+ * DS18B20 conversion time of \ref TEMP_RESOLUTION result [ms], 750ms for 12 bits.
+ */
+#define TEMP_CONVERSION_MS ( (750 + (1 << (12-TEMP_RESOLUTION)) - 1) >> (12-TEMP_RESOLUTION) )
 
 /**
- * \name 1wire low-level routines
- * @{
+ * Enable fast read of temperature, only 2 bytes of scratchpad without CRC are
+ * read if the result is plausible, see UpdateTemperature().
+ * Comment out to check CRC of every reading.
  */
-#define OW_GET_IN()   ( OW_IN & (1<<OW_PIN))
-#define OW_OUT_LOW()  ( OW_OUT &= (~(1 << OW_PIN)) )
-#define OW_OUT_HIGH() ( OW_OUT |= (1 << OW_PIN) )
-#define OW_DIR_IN()   ( OW_DDR &= (~(1 << OW_PIN )) )
-#define OW_DIR_OUT()  ( OW_DDR |= (1 << OW_PIN) )
-///@}
+#define TEMP_FAST_READ
 
 /**
- * \name 1wire commands
- * @{
+ * Maximal number of DS18B20 sensors on the bus, e.g. ambient, engine case and
+ * oil. Every sensor takes 8 bytes of RAM and EEPROM.
  */
-#define OW_SKIP_ROM     0xCC
-#define OW_CONVERT      0x44
-#define OW_READ         0xBE
-///@}
+#define TEMP_SENSORS 3
 
-uint8_t ow_reset(void);
-uint8_t ow_bit_io(uint8_t b);
-uint8_t ow_byte_wr(uint8_t b);
-uint8_t ow_byte_rd( void );
+extern int16_t g_nTemperature[ TEMP_SENSORS ];
 
-uint8_t StartTempConversion();
-uint8_t GetTempConversionResult();
-int FormatTemperature();
+void TempInit();
+uint8_t TempSensors();
+void UpdateTemperature();
+int FormatTemperature( uint8_t sensor );
 
 ///@}
 
@@ -0,0 +1,109 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Text streams
+ */
+
+#include "text.h"
+#include <stddef.h>
+#include <avr/eeprom.h>
+
+/**
+ * \defgroup text Text streams
+ * \brief Character by character access to text stored in RAM, program memory or EEPROM.
+ *
+ * Text is decoded when read, so it does not have to be copied to RAM
+ * before displaying.
+ * @{
+ */
+
+/**
+ * \brief Initialize text stream.
+ *
+ * \param pStream Stream to initialize.
+ * \param pSources Table of text sources. Must be valid as long as the stream is used.
+ * \param nSources Number of entries in \a pSources.
+ */
+void TextOpen( TEXTSTREAM* pStream, const TEXTSOURCE* pSources, uint8_t nSources )
+{
+	pStream->pSources = pSources;
+	pStream->nSources = nSources;
+	TextRewind( pStream );
+}
+
+/**
+ * \brief Move to the beginning of the text.
+ * \param pStream Text stream.
+ */
+void TextRewind( TEXTSTREAM* pStream )
+{
+	pStream->Source = 0;
+	pStream->Pos = 0;
+	pStream->Index = 0;
+}
+
+/**
+ * \brief Read the next character.
+ *
+ * \param pStream Text stream.
+ * \return Character code or 0 at the end of the text.
+ */
+char TextGetc( TEXTSTREAM* pStream )
+{
+	char c;
+
+	while( pStream->Source < pStream->nSources )
+	{
+		const TEXTSOURCE* pSrc = pStream->pSources + pStream->Source;
+
+		if( pStream->Pos < pSrc->Len )
+		{
+			if( TEXT_RAM == pSrc->Type )
+			{
+				c = pSrc->pText[ pStream->Pos ];
+			}
+			else if( TEXT_EE == pSrc->Type )
+			{
+				c = eeprom_read_byte( (const uint8_t*)pSrc->pText + pStream->Pos );
+				if( 0xFF == (uint8_t)c )
+					c = 0;
+			}
+			else
+			{
+				c = pgm_read_byte( pSrc->pText + pStream->Pos );
+				if( '|' == c )
+					c = 0;
+			}
+
+			if( c )
+			{
+				pStream->Pos++;
+				return c;
+			}
+		}
+
+		//end of this source
+		pStream->Source++;
+		pStream->Pos = 0;
+	}
+
+	return 0;
+}
+
+/** @} */
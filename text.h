@@ -0,0 +1,76 @@
+/*
+                          _   _                  _        __
+   __ _  __ _ _   _  __ _| |_(_) ___ _   _ ___  (_)_ __  / _| ___
+  / _` |/ _` | | | |/ _` | __| |/ __| | | / __| | | '_ \| |_ / _ \
+ | (_| | (_| | |_| | (_| | |_| | (__| |_| \__ \_| | | | |  _| (_) |
+  \__,_|\__, |\__,_|\__,_|\__|_|\___|\__,_|___(_)_|_| |_|_|  \___/
+           |_|
+
+ Copyright (c) 2012, All Right Reserved, http://aquaticus.info
+
+ THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ PARTICULAR PURPOSE.
+
+*/
+
+/**
+ * @file
+ * @brief Text streams header
+ */
+
+#ifndef TEXT_H_
+#define TEXT_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+/**
+ * \name Text source types
+ * @{
+ */
+/// Text in RAM
+#define TEXT_RAM 0
+/// Text in program memory
+#define TEXT_PGM 1
+/// Text in EEPROM
+#define TEXT_EE 2
+///@}
+
+/**
+ * One piece of text.
+ *
+ * Text ends after \a Len bytes or at 0. Text in program memory
+ * ends also at '|' (menu option separator), text in EEPROM at 0xFF
+ * (not programmed memory).
+ */
+typedef struct tagTEXTSOURCE
+{
+	uint8_t Type; ///< One of TEXT_RAM, TEXT_PGM, TEXT_EE
+	const char* pText; ///< Text address
+	uint8_t Len; ///< Maximum length of the text in bytes
+} TEXTSOURCE;
+
+/**
+ * Reads characters from one or more text sources, one after another.
+ *
+ * \sa TextOpen() TextGetc()
+ */
+typedef struct tagTEXTSTREAM
+{
+	const TEXTSOURCE* pSources; ///< Text sources
+	uint8_t nSources; ///< Number of sources
+	uint8_t Source; ///< Current source
+	uint8_t Pos; ///< Position in current source
+
+	int Index; ///< Position of \a Cur in text, used by ScrollLeftText()
+	char Cur; ///< Current character, used by ScrollLeftText()
+	char Next; ///< Next character, used by ScrollLeftText()
+} TEXTSTREAM;
+
+void TextOpen( TEXTSTREAM* pStream, const TEXTSOURCE* pSources, uint8_t nSources );
+void TextRewind( TEXTSTREAM* pStream );
+char TextGetc( TEXTSTREAM* pStream );
+
+#endif /* TEXT_H_ */